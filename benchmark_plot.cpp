@@ -0,0 +1,130 @@
+// Accuracy of the plot kernels against the C library, and the cost of sampling
+// a curve for the graph
+// Compile with: g++ -std=c++17 -O2 benchmark_plot.cpp -o benchmark_plot.exe
+// (add -march=native to run the plot kernels on AVX or AVX-512 vectors)
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "expression_engine.h"
+
+namespace {
+
+struct Sweep {
+    const char* label;
+    void (*fast)(const double*, double*, size_t);
+    double (*libm)(double);
+    double lo, hi;
+};
+
+// Seconds per call of f, best of five runs of `reps` calls
+template <class F>
+double timeCall(F f, int reps) {
+    double best = HUGE_VAL;
+    for (int run = 0; run < 5; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < reps; ++i) f();
+        std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+        best = std::min(best, d.count() / reps);
+    }
+    return best;
+}
+
+// The graph's original sampling: x substituted into the text, which is parsed
+// again at every pixel
+std::vector<double> sampleByText(const ExpressionEngine& engine, const std::wstring& expr, const std::vector<double>& xs) {
+    std::vector<double> out(xs.size());
+    for (size_t i = 0; i < xs.size(); ++i) {
+        std::wostringstream ss;
+        ss.precision(10);
+        ss << L"(" << xs[i] << L")";
+        std::wstring e = expr;
+        for (size_t pos = 0; (pos = e.find(L'x', pos)) != std::wstring::npos; pos += ss.str().size())
+            e.replace(pos, 1, ss.str());
+        try {
+            out[i] = engine.evaluate(e, AngleMode::Radians, 0, 0);
+        } catch (const std::exception&) {
+            out[i] = std::nan("");
+        }
+    }
+    return out;
+}
+
+}  // namespace
+
+int main() {
+    const Sweep sweeps[] = {
+        {"sin", fastSinBatch, [](double x) { return std::sin(x); }, -10, 10},
+        {"sin", fastSinBatch, [](double x) { return std::sin(x); }, -1e6, 1e6},
+        {"cos", fastCosBatch, [](double x) { return std::cos(x); }, -10, 10},
+        {"exp", fastExpBatch, [](double x) { return std::exp(x); }, -708, 709.7},
+        {"ln", fastLogBatch, [](double x) { return std::log(x); }, 1e-3, 1e3},
+        {"ln", fastLogBatch, [](double x) { return std::log(x); }, 1e-300, 1e300},
+    };
+    const size_t n = 1 << 22;
+
+    std::cout << "Plot kernels: " << kSimdLanes << " lanes per vector, " << n << " evenly spaced points per range\n\n";
+    std::cout << std::left << std::setw(6) << "func" << std::setw(20) << "range" << std::right << std::setw(12)
+              << "max rel" << std::setw(14) << "max ulp" << std::setw(12) << "fast" << std::setw(12) << "C library"
+              << "\n";
+    for (const Sweep& s : sweeps) {
+        // ln over many decades is swept in log scale
+        bool logScale = s.lo > 0 && s.hi / s.lo > 1e6;
+        std::vector<double> x(n), fast(n), lib(n);
+        for (size_t i = 0; i < n; ++i) {
+            double t = (i + 0.5) / n;
+            x[i] = logScale ? std::exp(std::log(s.lo) + t * (std::log(s.hi) - std::log(s.lo))) : s.lo + t * (s.hi - s.lo);
+        }
+        double tFast = timeCall([&] { s.fast(x.data(), fast.data(), n); }, 1) * 1e9 / n;
+        double tLib = timeCall([&] {
+            for (size_t i = 0; i < n; ++i) lib[i] = s.libm(x[i]);
+        }, 1) * 1e9 / n;
+        double worstRel = 0.0, worstUlp = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            if (fast[i] == lib[i] || lib[i] == 0.0) continue;
+            double err = std::fabs(fast[i] - lib[i]);
+            worstRel = std::max(worstRel, err / std::fabs(lib[i]));
+            worstUlp = std::max(worstUlp, err / std::ldexp(1.0, std::ilogb(lib[i]) - 52));
+        }
+        std::ostringstream range;
+        range << "[" << s.lo << ", " << s.hi << "]";
+        std::cout << std::left << std::setw(6) << s.label << std::setw(20) << range.str() << std::right
+                  << std::scientific << std::setprecision(2) << std::setw(12) << worstRel << std::setw(14) << worstUlp
+                  << std::fixed << std::setw(9) << tFast << " ns" << std::setw(9) << tLib << " ns\n";
+    }
+
+    // A graph sweep: one sample per pixel column
+    const std::wstring curves[] = {L"sin(x)", L"x^3 - 2x + 1", L"exp(-x^2/4)*cos(3x)", L"ln(abs(x)+1)*sin(x)^2",
+                                   L"1/(1+exp(-x))", L"pow(abs(x), 1.5) - 3"};
+    std::vector<double> xs(560);
+    for (size_t i = 0; i < xs.size(); ++i) xs[i] = -10.0 + 20.0 * i / xs.size();
+    ExpressionEngine engine;
+    std::cout << "\nSampling " << xs.size() << " pixels (microseconds per sweep)\n\n";
+    std::cout << std::left << std::setw(26) << "curve" << std::right << std::setw(12) << "reparsed" << std::setw(12)
+              << "full" << std::setw(12) << "fast" << std::setw(14) << "fast error" << "\n";
+    for (const std::wstring& c : curves) {
+        double tText = timeCall([&] { sampleByText(engine, c, xs); }, 20);
+        double tFull = timeCall([&] { engine.sample(c, L"x", xs, AngleMode::Radians, 0, 0); }, 200);
+        double tFast = timeCall([&] {
+            engine.sample(c, L"x", xs, AngleMode::Radians, 0, 0, Precision::Double, PlotPrecision::Fast);
+        }, 200);
+        std::vector<double> full = engine.sample(c, L"x", xs, AngleMode::Radians, 0, 0);
+        std::vector<double> fast =
+            engine.sample(c, L"x", xs, AngleMode::Radians, 0, 0, Precision::Double, PlotPrecision::Fast);
+        // Largest difference as a fraction of the curve's height, which is what a pixel measures
+        double worst = 0.0, height = 0.0;
+        for (size_t i = 0; i < xs.size(); ++i) {
+            worst = std::max(worst, std::fabs(fast[i] - full[i]));
+            height = std::max(height, std::fabs(full[i]));
+        }
+        worst /= height;
+        std::cout << std::left << std::setw(26) << std::string(c.begin(), c.end()) << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(12) << tText * 1e6 << std::setw(12) << tFull * 1e6
+                  << std::setw(12) << tFast * 1e6 << std::scientific << std::setprecision(2) << std::setw(14)
+                  << worst << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+// Cost of double-double evaluation against plain doubles
+// Compile with: g++ -std=c++17 -O2 benchmark_precision.cpp -o benchmark_precision.exe
+// (add -mfma where the CPU has it: the error-free products then take one instruction)
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include "expression_engine.h"
+
+namespace {
+
+// Seconds per evaluation, best of five runs of `reps` evaluations
+double timeEval(const ExpressionEngine& engine, const std::wstring& expr, AngleMode mode, Precision precision, int reps) {
+    double best = HUGE_VAL;
+    volatile double sink = 0.0;
+    for (int run = 0; run < 5; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < reps; ++i) {
+            Value v = engine.evaluateValue(expr, mode, 0, 0, precision);
+            sink = sink + v.at(0);
+        }
+        std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+        best = std::min(best, d.count() / reps);
+    }
+    return best;
+}
+
+}  // namespace
+
+int main() {
+    struct Case {
+        const char* label;
+        std::wstring expr;
+        AngleMode mode;
+        int reps;
+    };
+    const Case cases[] = {
+        {"arithmetic", L"(1e16 + 1) - 1e16", AngleMode::Radians, 20000},
+        {"dbv", L"dbv(1000000.000001, 1000000)", AngleMode::Radians, 20000},
+        {"geom", L"geom(1, 1.000000000001, 99)", AngleMode::Radians, 20000},
+        {"derivpow", L"derivpow(2, 3, 1e-12)", AngleMode::Radians, 20000},
+        {"preal (DEG)", L"preal(230, 6, 36.87)", AngleMode::Degrees, 20000},
+        {"trig mix", L"sin(1.2)^2 + cos(1.2)^2 + atan(0.5) + exp(-0.3)", AngleMode::Radians, 20000},
+        {"array, 10^5 elems", L"sum(sin(linspace(0, 10, 100000)) * exp(-linspace(0, 1, 100000)))", AngleMode::Radians, 5},
+    };
+
+    ExpressionEngine engine;
+    std::cout << "Double-double evaluation cost (parse included)\n\n";
+    std::cout << std::left << std::setw(20) << "case" << std::right << std::setw(14) << "double" << std::setw(14)
+              << "double-double" << std::setw(10) << "ratio" << "   results (double | double-double)\n";
+    for (const Case& c : cases) {
+        double t1 = timeEval(engine, c.expr, c.mode, Precision::Double, c.reps);
+        double t2 = timeEval(engine, c.expr, c.mode, Precision::DoubleDouble, c.reps);
+        double r1 = engine.evaluate(c.expr, c.mode, 0, 0);
+        double r2 = engine.evaluate(c.expr, c.mode, 0, 0, Precision::DoubleDouble);
+        std::cout << std::left << std::setw(20) << c.label << std::right << std::setw(11) << std::fixed
+                  << std::setprecision(2) << t1 * 1e6 << " us" << std::setw(11) << t2 * 1e6 << " us" << std::setw(9)
+                  << std::setprecision(1) << t2 / t1 << "x   " << std::defaultfloat << std::setprecision(17) << r1
+                  << " | " << r2 << "\n";
+    }
+    return 0;
+}
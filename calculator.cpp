@@ -10,505 +10,11 @@
 #include <string>
 #include <vector>
 #include <cwctype>
+#include "expression_engine.h"
 
 
 namespace {
 
-constexpr double kPi = 3.14159265358979323846;
-constexpr double kE = 2.71828182845904523536;
-
-enum class AngleMode { Radians, Degrees };
-
-struct FunctionSpec {
-    int arity;
-    std::function<double(const std::vector<double>&, AngleMode)> apply;
-};
-
-struct OperatorInfo {
-    int precedence;
-    bool rightAssociative;
-    int arity;
-};
-
-class ExpressionEngine {
-public:
-    ExpressionEngine() {
-        ops_[L"+"] = {2, false, 2};
-        ops_[L"-"] = {2, false, 2};
-        ops_[L"*"] = {3, false, 2};
-        ops_[L"/"] = {3, false, 2};
-        ops_[L"%"] = {3, false, 2};
-        ops_[L"^"] = {4, true, 2};
-        ops_[L"u+"] = {5, true, 1};
-        ops_[L"u-"] = {5, true, 1};
-        ops_[L"!"] = {6, false, 1};
-
-        funcs_[L"sin"] = {1, [](const std::vector<double>& a, AngleMode m) { return std::sin(toRad(a[0], m)); }};
-        funcs_[L"cos"] = {1, [](const std::vector<double>& a, AngleMode m) { return std::cos(toRad(a[0], m)); }};
-        funcs_[L"tan"] = {1, [](const std::vector<double>& a, AngleMode m) { return std::tan(toRad(a[0], m)); }};
-        funcs_[L"asin"] = {1, [](const std::vector<double>& a, AngleMode m) {
-                             if (a[0] < -1.0 || a[0] > 1.0) throw std::runtime_error("asin domain [-1,1]");
-                             double r = std::asin(a[0]);
-                             return m == AngleMode::Degrees ? (r * 180.0 / kPi) : r;
-                         }};
-        funcs_[L"acos"] = {1, [](const std::vector<double>& a, AngleMode m) {
-                             if (a[0] < -1.0 || a[0] > 1.0) throw std::runtime_error("acos domain [-1,1]");
-                             double r = std::acos(a[0]);
-                             return m == AngleMode::Degrees ? (r * 180.0 / kPi) : r;
-                         }};
-        funcs_[L"atan"] = {1, [](const std::vector<double>& a, AngleMode m) {
-                             double r = std::atan(a[0]);
-                             return m == AngleMode::Degrees ? (r * 180.0 / kPi) : r;
-                         }};
-        funcs_[L"sqrt"] = {1, [](const std::vector<double>& a, AngleMode) {
-                             if (a[0] < 0.0) throw std::runtime_error("sqrt domain x>=0");
-                             return std::sqrt(a[0]);
-                         }};
-        funcs_[L"ln"] = {1, [](const std::vector<double>& a, AngleMode) {
-                           if (a[0] <= 0.0) throw std::runtime_error("ln domain x>0");
-                           return std::log(a[0]);
-                       }};
-        funcs_[L"log"] = {1, [](const std::vector<double>& a, AngleMode) {
-                            if (a[0] <= 0.0) throw std::runtime_error("log domain x>0");
-                            return std::log10(a[0]);
-                        }};
-        funcs_[L"abs"] = {1, [](const std::vector<double>& a, AngleMode) { return std::fabs(a[0]); }};
-        funcs_[L"pow"] = {2, [](const std::vector<double>& a, AngleMode) { return std::pow(a[0], a[1]); }};
-        funcs_[L"min"] = {2, [](const std::vector<double>& a, AngleMode) { return std::min(a[0], a[1]); }};
-        funcs_[L"max"] = {2, [](const std::vector<double>& a, AngleMode) { return std::max(a[0], a[1]); }};
-
-        // Electrical Engineering Functions - Ohm's Law & Power
-        funcs_[L"pvi"] = {2, [](const std::vector<double>& a, AngleMode) { return a[0] * a[1]; }};  // P = V * I
-        funcs_[L"pir"] = {2, [](const std::vector<double>& a, AngleMode) { return a[0] * a[0] * a[1]; }};  // P = I² * R
-        funcs_[L"pvr"] = {2, [](const std::vector<double>& a, AngleMode) { return (a[0] * a[0]) / a[1]; }};  // P = V² / R
-        funcs_[L"vir"] = {2, [](const std::vector<double>& a, AngleMode) { return a[0] * a[1]; }};  // V = I * R
-        funcs_[L"ivr"] = {2, [](const std::vector<double>& a, AngleMode) { return a[0] / a[1]; }};  // I = V / R
-        funcs_[L"rvi"] = {2, [](const std::vector<double>& a, AngleMode) { return a[0] / a[1]; }};  // R = V / I
-
-        // Additional derived calculations
-        funcs_[L"vpi"] = {2, [](const std::vector<double>& a, AngleMode) { return a[0] / a[1]; }};  // V = P / I
-        funcs_[L"ipv"] = {2, [](const std::vector<double>& a, AngleMode) { return a[0] / a[1]; }};  // I = P / V
-        funcs_[L"rpi"] = {2, [](const std::vector<double>& a, AngleMode) { return (a[0] * a[1] * a[1]); }};  // R = P / I²
-        funcs_[L"rpv"] = {2, [](const std::vector<double>& a, AngleMode) { return (a[0] * a[1]) / (a[0] * a[0]); }};  // R = V² / P (fixed: V²/P)
-        funcs_[L"vpr"] = {2, [](const std::vector<double>& a, AngleMode) { return std::sqrt(a[0] * a[1]); }};  // V = √(P * R)
-        funcs_[L"ipr"] = {2, [](const std::vector<double>& a, AngleMode) { return std::sqrt(a[0] / a[1]); }};  // I = √(P / R)
-
-        // AC Power Functions (3-arg: V, I, angle in current mode)
-        funcs_[L"preal"] = {3, [](const std::vector<double>& a, AngleMode m) {
-                             double angle = toRad(a[2], m);
-                             return a[0] * a[1] * std::cos(angle);
-                         }};
-        funcs_[L"preact"] = {3, [](const std::vector<double>& a, AngleMode m) {
-                              double angle = toRad(a[2], m);
-                              return a[0] * a[1] * std::sin(angle);
-                          }};
-        funcs_[L"papp"] = {2, [](const std::vector<double>& a, AngleMode) { return a[0] * a[1]; }};  // Apparent power S = V * I
-        funcs_[L"pf"] = {1, [](const std::vector<double>& a, AngleMode m) {
-                          double angle = toRad(a[0], m);
-                          return std::cos(angle);
-                      }};
-
-        // Impedance & Reactance
-        funcs_[L"zrx"] = {2, [](const std::vector<double>& a, AngleMode) {
-                           return std::sqrt(a[0] * a[0] + a[1] * a[1]);
-                       }};  // Z = √(R² + X²)
-        funcs_[L"xc"] = {2, [](const std::vector<double>& a, AngleMode) {
-                          if (a[0] <= 0 || a[1] <= 0) throw std::runtime_error("xc args must be > 0");
-                          return 1.0 / (2.0 * kPi * a[0] * a[1]);
-                      }};  // Xc = 1/(2πfC)
-        funcs_[L"xl"] = {2, [](const std::vector<double>& a, AngleMode) {
-                          if (a[0] < 0 || a[1] < 0) throw std::runtime_error("xl args must be >= 0");
-                          return 2.0 * kPi * a[0] * a[1];
-                      }};  // Xl = 2πfL
-
-        // Resonant Frequency
-        funcs_[L"fres"] = {2, [](const std::vector<double>& a, AngleMode) {
-                            if (a[0] <= 0 || a[1] <= 0) throw std::runtime_error("fres args must be > 0");
-                            return 1.0 / (2.0 * kPi * std::sqrt(a[0] * a[1]));
-                        }};  // f₀ = 1/(2π√(LC))
-
-        // Decibel Calculations
-        funcs_[L"dbv"] = {2, [](const std::vector<double>& a, AngleMode) {
-                           if (a[0] <= 0 || a[1] <= 0) throw std::runtime_error("dbv args must be > 0");
-                           return 20.0 * std::log10(a[0] / a[1]);
-                       }};  // dB = 20*log10(V1/V2)
-        funcs_[L"dbp"] = {2, [](const std::vector<double>& a, AngleMode) {
-                           if (a[0] <= 0 || a[1] <= 0) throw std::runtime_error("dbp args must be > 0");
-                           return 10.0 * std::log10(a[0] / a[1]);
-                       }};  // dB = 10*log10(P1/P2)
-
-        // Voltage Divider
-        funcs_[L"vdiv"] = {3, [](const std::vector<double>& a, AngleMode) {
-                            if (a[1] + a[2] == 0) throw std::runtime_error("vdiv R1+R2 cannot be 0");
-                            return a[0] * a[2] / (a[1] + a[2]);
-                        }};  // Vout = Vin * R2 / (R1 + R2)
-
-        // === CALCULUS FUNCTIONS ===
-        
-        // Summation: sum(n) = 1+2+...+n = n(n+1)/2
-        funcs_[L"sum"] = {1, [](const std::vector<double>& a, AngleMode) {
-                           if (a[0] < 0 || !isNearlyInt(a[0])) throw std::runtime_error("sum needs integer >= 0");
-                           double n = std::round(a[0]);
-                           return n * (n + 1) / 2.0;
-                       }};
-        
-        // Sum of squares: sum2(n) = 1²+2²+...+n² = n(n+1)(2n+1)/6
-        funcs_[L"sum2"] = {1, [](const std::vector<double>& a, AngleMode) {
-                            if (a[0] < 0 || !isNearlyInt(a[0])) throw std::runtime_error("sum2 needs integer >= 0");
-                            double n = std::round(a[0]);
-                            return n * (n + 1) * (2 * n + 1) / 6.0;
-                        }};
-        
-        // Sum of cubes: sum3(n) = 1³+2³+...+n³ = (n(n+1)/2)²
-        funcs_[L"sum3"] = {1, [](const std::vector<double>& a, AngleMode) {
-                            if (a[0] < 0 || !isNearlyInt(a[0])) throw std::runtime_error("sum3 needs integer >= 0");
-                            double n = std::round(a[0]);
-                            double t = n * (n + 1) / 2.0;
-                            return t * t;
-                        }};
-        
-        // Geometric sum: geom(a, r, n) = a(1-r^n)/(1-r) for r≠1
-        funcs_[L"geom"] = {3, [](const std::vector<double>& a, AngleMode) {
-                            double a0 = a[0], r = a[1], n = a[2];
-                            if (std::fabs(r - 1.0) < 1e-12) return a0 * (n + 1);
-                            return a0 * (1.0 - std::pow(r, n + 1)) / (1.0 - r);
-                        }};
-        
-        // === NUMERICAL INTEGRALS ===
-        
-        // Integral of x^k from a to b: intpow(a, b, k) = (b^(k+1) - a^(k+1))/(k+1)
-        funcs_[L"intpow"] = {3, [](const std::vector<double>& a, AngleMode) {
-                             double lo = a[0], hi = a[1], k = a[2];
-                             if (std::fabs(k + 1) < 1e-12) {
-                                 // k = -1, integral of 1/x = ln(x)
-                                 if (lo <= 0 || hi <= 0) throw std::runtime_error("intpow: x must be > 0 for k=-1");
-                                 return std::log(hi) - std::log(lo);
-                             }
-                             return (std::pow(hi, k + 1) - std::pow(lo, k + 1)) / (k + 1);
-                         }};
-        
-        // Integral of e^x from a to b: intexp(a, b) = e^b - e^a
-        funcs_[L"intexp"] = {2, [](const std::vector<double>& a, AngleMode) {
-                             return std::exp(a[1]) - std::exp(a[0]);
-                         }};
-        
-        // Integral of sin(x) from a to b: intsin(a, b) = -cos(b) + cos(a)
-        funcs_[L"intsin"] = {2, [](const std::vector<double>& a, AngleMode) {
-                             return -std::cos(a[1]) + std::cos(a[0]);
-                         }};
-        
-        // Integral of cos(x) from a to b: intcos(a, b) = sin(b) - sin(a)
-        funcs_[L"intcos"] = {2, [](const std::vector<double>& a, AngleMode) {
-                             return std::sin(a[1]) - std::sin(a[0]);
-                         }};
-        
-        // Integral of 1/x from a to b: intlog(a, b) = ln(b) - ln(a)
-        funcs_[L"intlog"] = {2, [](const std::vector<double>& a, AngleMode) {
-                             if (a[0] <= 0 || a[1] <= 0) throw std::runtime_error("intlog: bounds must be > 0");
-                             return std::log(a[1]) - std::log(a[0]);
-                         }};
-        
-        // === NUMERICAL DERIVATIVES (using central difference) ===
-        
-        // Derivative of x^n at x: derivpow(x, n, h) ≈ n*x^(n-1)
-        funcs_[L"derivpow"] = {3, [](const std::vector<double>& a, AngleMode) {
-                               double x = a[0], n = a[1], h = a[2];
-                               if (h <= 0) h = 1e-6;
-                               // Central difference: (f(x+h) - f(x-h)) / (2h)
-                               double fxh = std::pow(x + h, n);
-                               double fxmh = std::pow(x - h, n);
-                               return (fxh - fxmh) / (2 * h);
-                           }};
-        
-        // Derivative of e^x at x: derivexp(x, h)
-        funcs_[L"derivexp"] = {2, [](const std::vector<double>& a, AngleMode) {
-                               double x = a[0], h = a[1];
-                               if (h <= 0) h = 1e-6;
-                               return (std::exp(x + h) - std::exp(x - h)) / (2 * h);
-                           }};
-        
-        // Derivative of sin(x) at x: derivsin(x, h)
-        funcs_[L"derivsin"] = {2, [](const std::vector<double>& a, AngleMode) {
-                               double x = a[0], h = a[1];
-                               if (h <= 0) h = 1e-6;
-                               return (std::sin(x + h) - std::sin(x - h)) / (2 * h);
-                           }};
-        
-        // Derivative of cos(x) at x: derivcos(x, h)
-        funcs_[L"derivcos"] = {2, [](const std::vector<double>& a, AngleMode) {
-                               double x = a[0], h = a[1];
-                               if (h <= 0) h = 1e-6;
-                               return (std::cos(x + h) - std::cos(x - h)) / (2 * h);
-                           }};
-        
-        // Derivative of ln(x) at x: derivln(x, h)
-        funcs_[L"derivln"] = {2, [](const std::vector<double>& a, AngleMode) {
-                              double x = a[0], h = a[1];
-                              if (h <= 0) h = 1e-6;
-                              if (x - h <= 0) throw std::runtime_error("derivln: x-h must be > 0");
-                              return (std::log(x + h) - std::log(x - h)) / (2 * h);
-                          }};
-        
-        // === LIMITS (numerical approximation) ===
-        
-        // Limit from right: limr(x0, h) - evaluates behavior as x -> x0+
-        // For x^n: lim(x0, n, dir) where dir=1 for right, -1 for left
-        funcs_[L"limpow"] = {3, [](const std::vector<double>& a, AngleMode) {
-                             double x0 = a[0], n = a[1], dir = a[2];
-                             double eps = 1e-10;
-                             double x = x0 + (dir >= 0 ? eps : -eps);
-                             return std::pow(x, n);
-                         }};
-    }
-
-    double evaluate(const std::wstring& expr, AngleMode mode, double ans, double mem) const {
-        std::map<std::wstring, double> vars{{L"pi", kPi}, {L"e", kE}, {L"ans", ans}, {L"mem", mem}};
-        auto tokens = tokenize(expr);
-        tokens = insertImplicitMult(tokens);
-        auto rpn = toRpn(tokens);
-        return evalRpn(rpn, mode, vars);
-    }
-
-private:
-    enum class TT { Number, Name, Operator, LParen, RParen, Comma };
-    struct Tok {
-        TT type;
-        std::wstring text;
-        double n = 0.0;
-    };
-
-    std::map<std::wstring, OperatorInfo> ops_;
-    std::map<std::wstring, FunctionSpec> funcs_;
-
-    static double toRad(double x, AngleMode m) {
-        return m == AngleMode::Degrees ? (x * kPi / 180.0) : x;
-    }
-
-    static bool isNearlyInt(double x) {
-        return std::fabs(x - std::round(x)) < 1e-12;
-    }
-
-    static double factorial(double x) {
-        if (x < 0 || !isNearlyInt(x)) throw std::runtime_error("factorial needs integer >= 0");
-        long long n = static_cast<long long>(std::llround(x));
-        if (n > 170) throw std::runtime_error("factorial too large (>170)");
-        double r = 1.0;
-        for (long long i = 2; i <= n; ++i) r *= i;
-        return r;
-    }
-
-    static std::wstring lower(std::wstring s) {
-        std::transform(s.begin(), s.end(), s.begin(), [](wchar_t c) {
-            return static_cast<wchar_t>(std::towlower(c));
-        });
-        return s;
-    }
-
-    std::vector<Tok> tokenize(const std::wstring& e) const {
-        std::vector<Tok> t;
-        for (size_t i = 0; i < e.size();) {
-            wchar_t c = e[i];
-            if (iswspace(c)) {
-                ++i;
-                continue;
-            }
-            if (iswdigit(c) || c == L'.') {
-                size_t j = i;
-                bool dot = false;
-                while (j < e.size()) {
-                    wchar_t d = e[j];
-                    if (d == L'.') {
-                        if (dot) break;
-                        dot = true;
-                        ++j;
-                    } else if (iswdigit(d)) {
-                        ++j;
-                    } else {
-                        break;
-                    }
-                }
-                auto s = e.substr(i, j - i);
-                t.push_back({TT::Number, s, std::stod(std::string(s.begin(), s.end()))});
-                i = j;
-                continue;
-            }
-            if (iswalpha(c) || c == L'_') {
-                size_t j = i;
-                while (j < e.size() && (iswalnum(e[j]) || e[j] == L'_')) ++j;
-                t.push_back({TT::Name, lower(e.substr(i, j - i)), 0.0});
-                i = j;
-                continue;
-            }
-            if (c == L'+' || c == L'-' || c == L'*' || c == L'/' || c == L'^' || c == L'%' || c == L'!') {
-                t.push_back({TT::Operator, std::wstring(1, c), 0.0});
-                ++i;
-                continue;
-            }
-            if (c == L'(') {
-                t.push_back({TT::LParen, L"(", 0.0});
-                ++i;
-                continue;
-            }
-            if (c == L')') {
-                t.push_back({TT::RParen, L")", 0.0});
-                ++i;
-                continue;
-            }
-            if (c == L',') {
-                t.push_back({TT::Comma, L",", 0.0});
-                ++i;
-                continue;
-            }
-            throw std::runtime_error("invalid character");
-        }
-        return t;
-    }
-
-    std::vector<Tok> insertImplicitMult(const std::vector<Tok>& in) const {
-        std::vector<Tok> out;
-        for (size_t i = 0; i < in.size(); ++i) {
-            out.push_back(in[i]);
-            if (i + 1 < in.size()) {
-                const Tok& cur = in[i];
-                const Tok& nxt = in[i + 1];
-                bool curVal = (cur.type == TT::Number || cur.type == TT::RParen ||
-                              (cur.type == TT::Operator && cur.text == L"!") ||
-                              (cur.type == TT::Name && funcs_.find(cur.text) == funcs_.end()));
-                bool nxtVal = (nxt.type == TT::Number || nxt.type == TT::LParen || nxt.type == TT::Name);
-                if (curVal && nxtVal) {
-                    out.push_back({TT::Operator, L"*", 0.0});
-                }
-            }
-        }
-        return out;
-    }
-
-    std::vector<Tok> toRpn(const std::vector<Tok>& in) const {
-        std::vector<Tok> out, st;
-        bool expectUnary = true;
-        for (size_t i = 0; i < in.size(); ++i) {
-            Tok tk = in[i];
-            if (tk.type == TT::Number) {
-                out.push_back(tk);
-                expectUnary = false;
-                continue;
-            }
-            if (tk.type == TT::Name) {
-                bool isFunc = (i + 1 < in.size() && in[i + 1].type == TT::LParen);
-                if (isFunc) st.push_back(tk);
-                else out.push_back(tk);
-                expectUnary = false;
-                continue;
-            }
-            if (tk.type == TT::Comma) {
-                while (!st.empty() && st.back().type != TT::LParen) {
-                    out.push_back(st.back());
-                    st.pop_back();
-                }
-                if (st.empty()) throw std::runtime_error("misplaced comma");
-                expectUnary = true;
-                continue;
-            }
-            if (tk.type == TT::Operator) {
-                if ((tk.text == L"+" || tk.text == L"-") && expectUnary) tk.text = (tk.text == L"+") ? L"u+" : L"u-";
-                auto cur = ops_.find(tk.text);
-                if (cur == ops_.end()) throw std::runtime_error("unsupported operator");
-                while (!st.empty() && st.back().type == TT::Operator) {
-                    auto top = ops_.find(st.back().text);
-                    if (top == ops_.end()) break;
-                    bool pop = cur->second.rightAssociative ? (cur->second.precedence < top->second.precedence)
-                                                            : (cur->second.precedence <= top->second.precedence);
-                    if (!pop) break;
-                    out.push_back(st.back());
-                    st.pop_back();
-                }
-                st.push_back(tk);
-                expectUnary = tk.text != L"!";
-                continue;
-            }
-            if (tk.type == TT::LParen) {
-                st.push_back(tk);
-                expectUnary = true;
-                continue;
-            }
-            if (tk.type == TT::RParen) {
-                bool found = false;
-                while (!st.empty()) {
-                    Tok top = st.back();
-                    st.pop_back();
-                    if (top.type == TT::LParen) {
-                        found = true;
-                        break;
-                    }
-                    out.push_back(top);
-                }
-                if (!found) throw std::runtime_error("mismatched parentheses");
-                if (!st.empty() && st.back().type == TT::Name) {
-                    out.push_back(st.back());
-                    st.pop_back();
-                }
-                expectUnary = false;
-            }
-        }
-        while (!st.empty()) {
-            if (st.back().type == TT::LParen) throw std::runtime_error("mismatched parentheses");
-            out.push_back(st.back());
-            st.pop_back();
-        }
-        return out;
-    }
-
-    double evalRpn(const std::vector<Tok>& rpn, AngleMode mode, const std::map<std::wstring, double>& vars) const {
-        std::vector<double> st;
-        for (const auto& tk : rpn) {
-            if (tk.type == TT::Number) {
-                st.push_back(tk.n);
-            } else if (tk.type == TT::Name) {
-                auto f = funcs_.find(tk.text);
-                if (f != funcs_.end()) {
-                    int a = f->second.arity;
-                    if (static_cast<int>(st.size()) < a) throw std::runtime_error("not enough function args");
-                    std::vector<double> args(a);
-                    for (int i = a - 1; i >= 0; --i) {
-                        args[i] = st.back();
-                        st.pop_back();
-                    }
-                    st.push_back(f->second.apply(args, mode));
-                } else {
-                    auto v = vars.find(tk.text);
-                    if (v == vars.end()) throw std::runtime_error("unknown identifier");
-                    st.push_back(v->second);
-                }
-            } else if (tk.type == TT::Operator) {
-                int a = ops_.at(tk.text).arity;
-                if (static_cast<int>(st.size()) < a) throw std::runtime_error("not enough operands");
-                if (a == 1) {
-                    double x = st.back();
-                    st.pop_back();
-                    if (tk.text == L"u+") st.push_back(+x);
-                    else if (tk.text == L"u-") st.push_back(-x);
-                    else if (tk.text == L"!") st.push_back(factorial(x));
-                } else {
-                    double b = st.back(); st.pop_back();
-                    double a1 = st.back(); st.pop_back();
-                    if (tk.text == L"+") st.push_back(a1 + b);
-                    else if (tk.text == L"-") st.push_back(a1 - b);
-                    else if (tk.text == L"*") st.push_back(a1 * b);
-                    else if (tk.text == L"/") {
-                        if (std::fabs(b) < 1e-15) throw std::runtime_error("division by zero");
-                        st.push_back(a1 / b);
-                    } else if (tk.text == L"%") {
-                        if (std::fabs(b) < 1e-15) throw std::runtime_error("modulo by zero");
-                        st.push_back(std::fmod(a1, b));
-                    } else if (tk.text == L"^") st.push_back(std::pow(a1, b));
-                }
-            }
-        }
-        if (st.size() != 1) throw std::runtime_error("invalid expression");
-        return st.back();
-    }
-};
-
 enum : int {
     IDC_EDIT = 1000,
     IDC_DEG_RAD = 1001,
@@ -526,6 +32,8 @@ enum : int {
     IDC_GRAPHCLEAR = 1013,
     IDC_ZOOMIN = 1014,
     IDC_ZOOMOUT = 1015,
+    IDC_PRECISION = 1016,
+    IDC_PLOTPRECISION = 1017,
     IDC_BTN_BASE = 2000
 };
 
@@ -711,6 +219,8 @@ double g_ans = 0.0;
 double g_mem = 0.0;
 bool g_justEvaluated = false;
 AngleMode g_mode = AngleMode::Radians;
+Precision g_precision = Precision::Double;
+PlotPrecision g_plotPrecision = PlotPrecision::Fast;
 
 // Graph state
 HWND g_hwndGraph = nullptr;
@@ -730,7 +240,7 @@ HBRUSH g_brushStatus = nullptr;
 COLORREF buttonBgColor(int id) {
     if (id == IDC_EQUALS) return RGB(33, 150, 243);
     if (id == IDC_CLEAR || id == IDC_BACK) return RGB(239, 83, 80);
-    if (id == IDC_DEG_RAD) return RGB(171, 71, 188);
+    if (id == IDC_DEG_RAD || id == IDC_PRECISION || id == IDC_PLOTPRECISION) return RGB(171, 71, 188);
     if (id >= IDC_MS && id <= IDC_MMINUS) return RGB(0, 150, 136);
     if (id >= IDC_BTN_BASE && id < IDC_BTN_BASE + static_cast<int>(std::size(kButtons))) {
         const std::wstring t = kButtons[id - IDC_BTN_BASE].label;
@@ -784,6 +294,23 @@ void appendToEdit(HWND edit, const std::wstring& text) {
     SendMessageW(edit, EM_REPLACESEL, TRUE, reinterpret_cast<LPARAM>(text.c_str()));
 }
 
+// Arrays are shown as list literals so the result can be edited and re-evaluated
+std::wstring formatValue(const Value& v) {
+    std::wostringstream ss;
+    ss.precision(15);
+    if (!v.isArray) {
+        ss << v.num;
+        return ss.str();
+    }
+    ss << L"[";
+    for (size_t i = 0; i < v.arr.size(); ++i) {
+        if (i) ss << L", ";
+        ss << v.arr[i];
+    }
+    ss << L"]";
+    return ss.str();
+}
+
 void evaluateNow(HWND hwnd) {
     HWND edit = GetDlgItem(hwnd, IDC_EDIT);
     std::wstring expr = getText(edit);
@@ -796,12 +323,27 @@ void evaluateNow(HWND hwnd) {
     }
     for (int i = 0; i < openParens; i++) expr += L")";
     try {
-        double result = g_engine.evaluate(expr, g_mode, g_ans, g_mem);
-        g_ans = result;
-        std::wostringstream ss;
-        ss.precision(15);
-        ss << result;
-        setText(edit, ss.str());
+        // diff(f, x) with a free x shows the derivative itself, ready to plot
+        std::wstring derivative;
+        if (g_engine.symbolicDerivative(expr, g_mode, derivative)) {
+            setText(edit, derivative);
+            setStatus(hwnd, L"OK - symbolic derivative");
+            g_justEvaluated = true;
+            return;
+        }
+        // Exact mode prints integer results in full, whatever their length
+        std::wstring digits;
+        if (g_precision == Precision::Exact && g_engine.evaluateExact(expr, g_mode, g_ans, g_mem, digits)) {
+            g_ans = wcstod(digits.c_str(), nullptr);
+            setText(edit, digits);
+            size_t count = digits.size() - (digits[0] == L'-' ? 1 : 0);
+            setStatus(hwnd, L"OK - exact integer (" + std::to_wstring(count) + L" digits)");
+            g_justEvaluated = true;
+            return;
+        }
+        Value result = g_engine.evaluateValue(expr, g_mode, g_ans, g_mem, g_precision);
+        if (!result.isArray) g_ans = result.num;
+        setText(edit, formatValue(result));
         setStatus(hwnd, L"OK");
         g_justEvaluated = true;
     } catch (...) {
@@ -909,6 +451,16 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
         HWND btnZoomOut = CreateWindowW(L"BUTTON", L"Zoom-", WS_CHILD | WS_VISIBLE | BS_OWNERDRAW,
                       755, 650, 55, 28, hwnd, reinterpret_cast<HMENU>(IDC_ZOOMOUT), nullptr, nullptr);
         SendMessageW(btnZoomOut, WM_SETFONT, reinterpret_cast<WPARAM>(g_fontButton), TRUE);
+
+        // Arithmetic precision toggle: double or double-double (~32 digits)
+        HWND btnPrecision = CreateWindowW(L"BUTTON", L"Precision: double", WS_CHILD | WS_VISIBLE | BS_OWNERDRAW,
+                      555, 685, 165, 28, hwnd, reinterpret_cast<HMENU>(IDC_PRECISION), nullptr, nullptr);
+        SendMessageW(btnPrecision, WM_SETFONT, reinterpret_cast<WPARAM>(g_fontButton), TRUE);
+
+        // Plot kernels: fast polynomials (~1e-7) or the full-precision built-ins
+        HWND btnPlotPrecision = CreateWindowW(L"BUTTON", L"Plot: fast", WS_CHILD | WS_VISIBLE | BS_OWNERDRAW,
+                      725, 685, 85, 28, hwnd, reinterpret_cast<HMENU>(IDC_PLOTPRECISION), nullptr, nullptr);
+        SendMessageW(btnPlotPrecision, WM_SETFONT, reinterpret_cast<WPARAM>(g_fontButton), TRUE);
         
         return 0;
     }
@@ -989,47 +541,38 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                 HPEN funcPen = CreatePen(PS_SOLID, 2, RGB(0, 255, 100));
                 SelectObject(dis->hDC, funcPen);
                 
+                // One sample per pixel column, all evaluated in one pass
+                std::vector<double> xs(width > 0 ? width : 0);
+                for (int px = 0; px < width; px++)
+                    xs[px] = g_graphXMin + (static_cast<double>(px) / width) * (g_graphXMax - g_graphXMin);
+                std::vector<double> ys;
+                try {
+                    ys = g_engine.sample(g_graphExpr, L"x", xs, g_mode, g_ans, g_mem, g_precision, g_plotPrecision);
+                } catch (...) {
+                    ys.assign(xs.size(), std::nan(""));
+                }
+
                 bool firstPoint = true;
                 for (int px = 0; px < width; px++) {
-                    double x = g_graphXMin + (static_cast<double>(px) / width) * (g_graphXMax - g_graphXMin);
+                    double y = ys[px];
                     
-                    // Substitute x value into expression
-                    std::wostringstream ss;
-                    ss.precision(10);
-                    ss << L"(" << x << L")";
-                    std::wstring xVal = ss.str();
-                    
-                    // Replace 'x' with the value
-                    std::wstring evalExpr = g_graphExpr;
-                    size_t pos = 0;
-                    while ((pos = evalExpr.find(L'x', pos)) != std::wstring::npos) {
-                        evalExpr.replace(pos, 1, xVal);
-                        pos += xVal.length();
-                    }
-                    
-                    try {
-                        double y = g_engine.evaluate(evalExpr, g_mode, g_ans, g_mem);
+                    // Check for valid y value
+                    if (!std::isnan(y) && !std::isinf(y) && 
+                        y >= g_graphYMin - 100 && y <= g_graphYMax + 100) {
+                        
+                        int py = rc.bottom - static_cast<int>((y - g_graphYMin) / (g_graphYMax - g_graphYMin) * height);
                         
-                        // Check for valid y value
-                        if (!std::isnan(y) && !std::isinf(y) && 
-                            y >= g_graphYMin - 100 && y <= g_graphYMax + 100) {
-                            
-                            int py = rc.bottom - static_cast<int>((y - g_graphYMin) / (g_graphYMax - g_graphYMin) * height);
-                            
-                            if (py >= rc.top && py <= rc.bottom) {
-                                if (firstPoint) {
-                                    MoveToEx(dis->hDC, rc.left + px, py, nullptr);
-                                    firstPoint = false;
-                                } else {
-                                    LineTo(dis->hDC, rc.left + px, py);
-                                }
+                        if (py >= rc.top && py <= rc.bottom) {
+                            if (firstPoint) {
+                                MoveToEx(dis->hDC, rc.left + px, py, nullptr);
+                                firstPoint = false;
                             } else {
-                                firstPoint = true;
+                                LineTo(dis->hDC, rc.left + px, py);
                             }
                         } else {
                             firstPoint = true;
                         }
-                    } catch (...) {
+                    } else {
                         firstPoint = true;
                     }
                 }
@@ -1133,6 +676,34 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
             g_mode = (g_mode == AngleMode::Radians) ? AngleMode::Degrees : AngleMode::Radians;
             setStatus(hwnd, g_mode == AngleMode::Radians ? L"Mode: RAD" : L"Mode: DEG");
             return 0;
+        case IDC_PRECISION: {
+            // double -> double-double -> exact integers -> double
+            const wchar_t* label = L"Precision: double";
+            const wchar_t* status = L"Precision: double (~16 digits)";
+            if (g_precision == Precision::Double) {
+                g_precision = Precision::DoubleDouble;
+                label = L"Precision: double-double";
+                status = L"Precision: double-double (~32 digits)";
+            } else if (g_precision == Precision::DoubleDouble) {
+                g_precision = Precision::Exact;
+                label = L"Precision: exact integers";
+                status = L"Precision: exact integers, floats where needed";
+            } else {
+                g_precision = Precision::Double;
+            }
+            setText(GetDlgItem(hwnd, IDC_PRECISION), label);
+            setStatus(hwnd, status);
+            return 0;
+        }
+        case IDC_PLOTPRECISION: {
+            bool fast = g_plotPrecision == PlotPrecision::Full;
+            g_plotPrecision = fast ? PlotPrecision::Fast : PlotPrecision::Full;
+            setText(GetDlgItem(hwnd, IDC_PLOTPRECISION), fast ? L"Plot: fast" : L"Plot: full");
+            setStatus(hwnd, fast ? L"Plot kernels: fast (~1e-7 relative, double precision only)"
+                                 : L"Plot kernels: full precision");
+            InvalidateRect(g_hwndGraph, nullptr, TRUE);
+            return 0;
+        }
         case IDC_MS:
             g_mem = g_ans;
             setStatus(hwnd, L"Memory stored");
@@ -1193,29 +764,19 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                 double yMin = 1e30, yMax = -1e30;
                 bool foundValid = false;
                 
-                for (int px = 0; px < 280; px++) {
-                    double x = g_graphXMin + (static_cast<double>(px) / 280.0) * (g_graphXMax - g_graphXMin);
-                    
-                    std::wostringstream ss;
-                    ss.precision(10);
-                    ss << L"(" << x << L")";
-                    std::wstring xVal = ss.str();
-                    
-                    std::wstring evalExpr = g_graphExpr;
-                    size_t pos = 0;
-                    while ((pos = evalExpr.find(L'x', pos)) != std::wstring::npos) {
-                        evalExpr.replace(pos, 1, xVal);
-                        pos += xVal.length();
+                std::vector<double> xs(280), ys;
+                for (int px = 0; px < 280; px++)
+                    xs[px] = g_graphXMin + (static_cast<double>(px) / 280.0) * (g_graphXMax - g_graphXMin);
+                try {
+                    ys = g_engine.sample(g_graphExpr, L"x", xs, g_mode, g_ans, g_mem, g_precision, g_plotPrecision);
+                } catch (...) {}
+
+                for (double y : ys) {
+                    if (!std::isnan(y) && !std::isinf(y) && std::fabs(y) < 1e10) {
+                        if (y < yMin) yMin = y;
+                        if (y > yMax) yMax = y;
+                        foundValid = true;
                     }
-                    
-                    try {
-                        double y = g_engine.evaluate(evalExpr, g_mode, g_ans, g_mem);
-                        if (!std::isnan(y) && !std::isinf(y) && std::fabs(y) < 1e10) {
-                            if (y < yMin) yMin = y;
-                            if (y > yMax) yMax = y;
-                            foundValid = true;
-                        }
-                    } catch (...) {}
                 }
                 
                 if (foundValid && yMax > yMin) {
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include "polynomial.h"
 
 // Define M_PI if not defined
 #ifndef M_PI
@@ -20,9 +21,6 @@
 #define MIN_WIDTH 500
 #define MIN_HEIGHT 400
 
-// Max terms in polynomial
-#define MAX_TERMS 10
-
 // Button IDs
 #define ID_NUM_0 100
 #define ID_NUM_1 101
@@ -53,6 +51,10 @@
 #define ID_DIFF 126  // New differentiation button
 #define ID_INT 127   // New integration button
 #define ID_X 128     // New X variable button
+#define ID_ROOTS 129 // Roots of the polynomial on the display
+
+// Highest degree the roots button solves; the work grows as its square
+#define MAX_ROOT_DEGREE 1000
 
 // Custom colors
 #define BG_COLOR RGB(45, 45, 45)
@@ -70,12 +72,6 @@
 LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
 LRESULT CALLBACK ButtonProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
-// Polynomial term structure
-typedef struct {
-    double coefficient;
-    int exponent;
-} Term;
-
 // Global variables
 double memory = 0.0;
 double currentValue = 0.0;
@@ -95,82 +91,32 @@ HBRUSH hbrEquals;
 HBRUSH hbrClear;
 HBRUSH hbrCalculus;
 
-// Function to parse polynomial string into terms
-int parsePolynomial(const wchar_t* input, Term* terms) {
-    int termCount = 0;
-    wchar_t* str = _wcsdup(input);
-    wchar_t* token = wcstok(str, L"+", NULL);
-    
-    while (token && termCount < MAX_TERMS) {
-        Term* term = &terms[termCount];
-        wchar_t* xPos = wcschr(token, L'x');
-        
-        if (xPos) {
-            // Term has x
-            wchar_t* expPos = wcschr(xPos, L'^');
-            if (expPos) {
-                // Term has exponent
-                *xPos = L'\0';
-                term->exponent = _wtoi(expPos + 1);
-            } else {
-                // x without exponent
-                *xPos = L'\0';
-                term->exponent = 1;
-            }
-            term->coefficient = wcslen(token) ? _wtof(token) : 1.0;
-        } else {
-            // Constant term
-            term->coefficient = _wtof(token);
-            term->exponent = 0;
-        }
-        termCount++;
-        token = wcstok(NULL, L"+", NULL);
-    }
-    
-    free(str);
-    return termCount;
-}
-
-// Function to differentiate polynomial
-void differentiate(Term* terms, int termCount) {
-    for (int i = 0; i < termCount; i++) {
-        if (terms[i].exponent > 0) {
-            terms[i].coefficient *= terms[i].exponent;
-            terms[i].exponent--;
-        } else {
-            terms[i].coefficient = 0;
-        }
-    }
-}
-
-// Function to integrate polynomial
-void integrate(Term* terms, int termCount) {
-    for (int i = 0; i < termCount; i++) {
-        terms[i].exponent++;
-        terms[i].coefficient /= terms[i].exponent;
-    }
+// Reads the display as a polynomial, dropping the "+C" left by a previous
+// integration; false when it is not one
+int readPolynomial(HWND hInput, Polynomial* poly) {
+    wchar_t buffer[256];
+    GetWindowTextW(hInput, buffer, 256);
+    size_t len = wcslen(buffer);
+    if (len >= 2 && wcscmp(buffer + len - 2, L"+C") == 0) buffer[len - 2] = L'\0';
+    return poly_parse(buffer, poly);
 }
 
-// Function to convert terms back to string
-void termsToString(Term* terms, int termCount, wchar_t* output, size_t outputSize) {
+// Writes roots as "1, 2, -0.5+0.866i", truncated to fit size wide characters
+void FormatRoots(const double* re, const double* im, size_t count, wchar_t* output, size_t size) {
+    size_t used = 0;
     output[0] = L'\0';
-    for (int i = 0; i < termCount; i++) {
-        wchar_t term[64];
-        if (terms[i].coefficient == 0) continue;
-        
-        if (i > 0 && terms[i].coefficient > 0) wcscat_s(output, outputSize, L"+");
-        
-        if (terms[i].exponent == 0) {
-            swprintf(term, 64, L"%.2f", terms[i].coefficient);
-        } else if (terms[i].exponent == 1) {
-            swprintf(term, 64, L"%.2fx", terms[i].coefficient);
-        } else {
-            swprintf(term, 64, L"%.2fx^%d", terms[i].coefficient, terms[i].exponent);
-        }
-        wcscat_s(output, outputSize, term);
+    for (size_t i = 0; i < count; i++) {
+        wchar_t root[64];
+        const wchar_t* separator = i > 0 ? L", " : L"";
+        if (im[i] == 0.0)
+            swprintf(root, 64, L"%ls%g", separator, re[i]);
+        else
+            swprintf(root, 64, L"%ls%g%+gi", separator, re[i], im[i]);
+        size_t len = wcslen(root);
+        if (used + len >= size) break;
+        memcpy(output + used, root, (len + 1) * sizeof(wchar_t));
+        used += len;
     }
-    
-    if (output[0] == L'\0') wcscpy_s(output, outputSize, L"0");
 }
 
 void AppendNumber(HWND hInput, const wchar_t* number) {
@@ -228,7 +174,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                 {ID_NUM_0, L"0", 4, 0, hbrNumber}, {ID_DOT, L".", 4, 1, hbrNumber}, {ID_EQ, L"=", 4, 2, hbrEquals},
                 {ID_DIV, L"÷", 4, 3, hbrOperator}, {ID_SQRT, L"√", 4, 4, hbrFunction}, {ID_POW, L"^", 4, 5, hbrOperator},
                 {ID_MC, L"MC", 5, 0, hbrMemory}, {ID_MR, L"MR", 5, 1, hbrMemory}, {ID_MP, L"M+", 5, 2, hbrMemory},
-                {ID_CLR, L"C", 5, 3, hbrClear}
+                {ID_CLR, L"C", 5, 3, hbrClear}, {ID_ROOTS, L"roots", 5, 5, hbrCalculus}
             };
             
             int buttonWidth = 70;
@@ -261,22 +207,53 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                 // ... [Previous command handling remains the same] ...
 
                 case ID_DIFF: {
-                    GetWindowTextW(hInput, buffer, 256);
-                    Term terms[MAX_TERMS];
-                    int termCount = parsePolynomial(buffer, terms);
-                    differentiate(terms, termCount);
-                    termsToString(terms, termCount, buffer, 256);
+                    Polynomial poly;
+                    poly_init(&poly);
+                    if (readPolynomial(hInput, &poly)) {
+                        poly_derivative(&poly);
+                        if (poly_to_string(&poly, buffer, 256) >= 256) wcscpy_s(buffer, 256, L"Result too long");
+                    } else {
+                        wcscpy_s(buffer, 256, L"Error");
+                    }
+                    poly_free(&poly);
                     SetWindowTextW(hInput, buffer);
                     break;
                 }
 
                 case ID_INT: {
-                    GetWindowTextW(hInput, buffer, 256);
-                    Term terms[MAX_TERMS];
-                    int termCount = parsePolynomial(buffer, terms);
-                    integrate(terms, termCount);
-                    termsToString(terms, termCount, buffer, 256);
-                    wcscat_s(buffer, 256, L"+C");  // Add constant of integration
+                    Polynomial poly;
+                    poly_init(&poly);
+                    if (readPolynomial(hInput, &poly) && poly_integral(&poly)) {
+                        if (poly_to_string(&poly, buffer, 250) >= 250)
+                            wcscpy_s(buffer, 256, L"Result too long");
+                        else
+                            wcscat_s(buffer, 256, L"+C");  // Add constant of integration
+                    } else {
+                        wcscpy_s(buffer, 256, L"Error");
+                    }
+                    poly_free(&poly);
+                    SetWindowTextW(hInput, buffer);
+                    break;
+                }
+
+                case ID_ROOTS: {
+                    Polynomial poly;
+                    poly_init(&poly);
+                    wcscpy_s(buffer, 256, L"Error");
+                    if (readPolynomial(hInput, &poly) && poly.count && poly.terms[0].exponent <= MAX_ROOT_DEGREE) {
+                        size_t degree = (size_t)poly.terms[0].exponent;
+                        double* re = (double*)malloc((degree + 1) * sizeof(double));
+                        double* im = (double*)malloc((degree + 1) * sizeof(double));
+                        if (re && im && poly_roots(&poly, re, im) != (size_t)-1) {
+                            if (degree == 0)
+                                wcscpy_s(buffer, 256, L"No roots");
+                            else
+                                FormatRoots(re, im, degree, buffer, 256);
+                        }
+                        free(re);
+                        free(im);
+                    }
+                    poly_free(&poly);
                     SetWindowTextW(hInput, buffer);
                     break;
                 }
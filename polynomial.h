@@ -0,0 +1,509 @@
+// Sparse polynomials in x, shared by calculator_dev.c (its d/dx, integral and
+// roots buttons) and the expression engine (coeffs, polyval, polyder, polyint,
+// roots and the plot sampler). Terms are kept sorted by descending exponent
+// with equal exponents merged and zero coefficients dropped, so x^1000 + 1 is
+// two terms and Horner's rule can jump straight across the gaps.
+#ifndef POLYNOMIAL_H
+#define POLYNOMIAL_H
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <wctype.h>
+
+// Points evaluated together by poly_eval_many, small enough to stay in L1
+#define POLY_BLOCK 256
+
+// Aberth sweeps before poly_roots gives up; it usually needs 10 to 20
+#define POLY_ROOT_ITERATIONS 100
+
+// Points evaluated side by side in poly_newton_many, so that independent
+// Horner chains hide the multiply-add latency
+#define POLY_NEWTON_TILE 16
+
+// Polynomial term structure
+typedef struct {
+    double coefficient;
+    int exponent;
+} Term;
+
+typedef struct {
+    Term* terms;  // descending exponents once normalized
+    size_t count;
+    size_t capacity;
+} Polynomial;
+
+static inline void poly_init(Polynomial* p) {
+    p->terms = NULL;
+    p->count = 0;
+    p->capacity = 0;
+}
+
+static inline void poly_free(Polynomial* p) {
+    free(p->terms);
+    poly_init(p);
+}
+
+// Room for at least n terms; false when out of memory
+static inline bool poly_reserve(Polynomial* p, size_t n) {
+    if (n <= p->capacity) return true;
+    size_t cap = p->capacity ? p->capacity : 8;
+    while (cap < n) cap *= 2;
+    Term* grown = (Term*)realloc(p->terms, cap * sizeof(Term));
+    if (!grown) return false;
+    p->terms = grown;
+    p->capacity = cap;
+    return true;
+}
+
+// Appends c x^e in any order; poly_normalize() sorts and merges
+static inline bool poly_add_term(Polynomial* p, double c, int e) {
+    if (!poly_reserve(p, p->count + 1)) return false;
+    p->terms[p->count].coefficient = c;
+    p->terms[p->count].exponent = e;
+    p->count++;
+    return true;
+}
+
+static inline int poly_compare_terms(const void* a, const void* b) {
+    int ea = ((const Term*)a)->exponent, eb = ((const Term*)b)->exponent;
+    return (ea < eb) - (ea > eb);
+}
+
+// Sorts by descending exponent, merges equal exponents and drops zeros
+static inline void poly_normalize(Polynomial* p) {
+    if (p->count > 1) qsort(p->terms, p->count, sizeof(Term), poly_compare_terms);
+    size_t out = 0;
+    for (size_t i = 0; i < p->count;) {
+        Term t = p->terms[i++];
+        while (i < p->count && p->terms[i].exponent == t.exponent) t.coefficient += p->terms[i++].coefficient;
+        if (t.coefficient != 0.0) p->terms[out++] = t;
+    }
+    p->count = out;
+}
+
+// Parses sums of terms such as "3x^2 - 2x + 1", "-x^3+0.5x" or "2*x^10 - 7".
+// Exponents are non-negative integers. Returns false on anything else.
+static inline bool poly_parse(const wchar_t* s, Polynomial* p) {
+    p->count = 0;
+    bool first = true;
+    while (iswspace(*s)) s++;
+    if (!*s) return false;
+    while (*s) {
+        double sign = 1.0;
+        if (*s == L'+' || *s == L'-') {
+            sign = *s == L'-' ? -1.0 : 1.0;
+            s++;
+            while (iswspace(*s)) s++;
+        } else if (!first) {
+            return false;
+        }
+
+        double coefficient = 1.0;
+        int exponent = 0;
+        bool number = iswdigit(*s) || *s == L'.';
+        if (number) {
+            wchar_t* end;
+            coefficient = wcstod(s, &end);
+            if (end == s) return false;
+            s = end;
+            while (iswspace(*s)) s++;
+            if (*s == L'*') {
+                s++;
+                while (iswspace(*s)) s++;
+                if (*s != L'x' && *s != L'X') return false;
+            }
+        }
+        if (*s == L'x' || *s == L'X') {
+            exponent = 1;
+            s++;
+            while (iswspace(*s)) s++;
+            if (*s == L'^') {
+                s++;
+                while (iswspace(*s)) s++;
+                if (!iswdigit(*s)) return false;
+                wchar_t* end;
+                long e = wcstol(s, &end, 10);
+                if (e > INT_MAX) return false;
+                exponent = (int)e;
+                s = end;
+            }
+        } else if (!number) {
+            return false;
+        }
+        if (!poly_add_term(p, sign * coefficient, exponent)) return false;
+        while (iswspace(*s)) s++;
+        first = false;
+    }
+    poly_normalize(p);
+    return true;
+}
+
+// d/dx in place, one pass: exponents stay distinct and descending
+static inline void poly_derivative(Polynomial* p) {
+    size_t out = 0;
+    for (size_t i = 0; i < p->count; i++) {
+        Term t = p->terms[i];
+        if (t.exponent == 0) continue;
+        t.coefficient *= t.exponent;
+        t.exponent--;
+        p->terms[out++] = t;
+    }
+    p->count = out;
+}
+
+// Antiderivative with zero constant, in place; false if an exponent would overflow
+static inline bool poly_integral(Polynomial* p) {
+    if (p->count && p->terms[0].exponent == INT_MAX) return false;
+    for (size_t i = 0; i < p->count; i++) {
+        p->terms[i].exponent++;
+        p->terms[i].coefficient /= p->terms[i].exponent;
+    }
+    return true;
+}
+
+// x^n by repeated squaring
+static inline double poly_ipow(double x, unsigned n) {
+    double r = 1.0;
+    for (; n; n >>= 1) {
+        if (n & 1) r *= x;
+        x *= x;
+    }
+    return r;
+}
+
+// Horner's rule over the sparse terms of a normalized polynomial
+static inline double poly_eval(const Polynomial* p, double x) {
+    if (!p->count) return 0.0;
+    double r = p->terms[0].coefficient;
+    for (size_t i = 1; i < p->count; i++)
+        r = r * poly_ipow(x, (unsigned)(p->terms[i - 1].exponent - p->terms[i].exponent)) + p->terms[i].coefficient;
+    return r * poly_ipow(x, (unsigned)p->terms[p->count - 1].exponent);
+}
+
+// out[i] = p(x[i]), the same Horner steps as poly_eval. Points go through in
+// blocks of POLY_BLOCK with each step applied to the whole block, so the
+// dense case (gaps of 1) is one multiply-add per point per term in a loop the
+// compiler vectorizes, and x^gap for sparse gaps is squared up for the block at once.
+static inline void poly_eval_many(const Polynomial* p, const double* x, double* out, size_t n) {
+    double power[POLY_BLOCK], base[POLY_BLOCK];
+    for (size_t start = 0; start < n; start += POLY_BLOCK) {
+        size_t m = n - start < POLY_BLOCK ? n - start : POLY_BLOCK;
+        const double* xb = x + start;
+        double* r = out + start;
+        double lead = p->count ? p->terms[0].coefficient : 0.0;
+        for (size_t i = 0; i < m; i++) r[i] = lead;
+        for (size_t t = 1; t <= p->count; t++) {
+            unsigned gap = (unsigned)(p->terms[t - 1].exponent - (t < p->count ? p->terms[t].exponent : 0));
+            double c = t < p->count ? p->terms[t].coefficient : 0.0;
+            if (gap == 1) {
+                for (size_t i = 0; i < m; i++) r[i] = r[i] * xb[i] + c;
+                continue;
+            }
+            if (gap == 0) continue;  // the last term is a constant
+            for (size_t i = 0; i < m; i++) {
+                power[i] = 1.0;
+                base[i] = xb[i];
+            }
+            for (; gap; gap >>= 1) {
+                if (gap & 1)
+                    for (size_t i = 0; i < m; i++) power[i] *= base[i];
+                if (gap > 1)
+                    for (size_t i = 0; i < m; i++) base[i] *= base[i];
+            }
+            for (size_t i = 0; i < m; i++) r[i] = r[i] * power[i] + c;
+        }
+    }
+}
+
+// A complex root, as poly_roots sorts them
+typedef struct {
+    double re, im;
+} PolyRoot;
+
+static inline int poly_compare_roots(const void* a, const void* b) {
+    const PolyRoot* x = (const PolyRoot*)a;
+    const PolyRoot* y = (const PolyRoot*)b;
+    if (x->re != y->re) return x->re < y->re ? -1 : 1;
+    return (x->im > y->im) - (x->im < y->im);
+}
+
+// (ar + i ai) / (br + i bi) by Smith's method, which scales by the larger
+// part of the divisor so neither |b|^2 nor the products underflow
+static inline void poly_cdiv(double ar, double ai, double br, double bi, double* rr, double* ri) {
+    if (fabs(br) >= fabs(bi)) {
+        double t = bi / br, den = br + bi * t;
+        *rr = (ar + ai * t) / den;
+        *ri = (ai - ar * t) / den;
+    } else {
+        double t = br / bi, den = br * t + bi;
+        *rr = (ar * t + ai) / den;
+        *ri = (ai * t - ar) / den;
+    }
+}
+
+// Newton corrections p(z)/p'(z) at m points for the dense a[0] + a[1] z +
+// ... + a[d] z^d, d >= 1 and a[0], a[d] nonzero. Points outside the unit
+// circle go through the reversed polynomial at 1/z, so large roots cannot
+// overflow. The points run through Horner's rule in tiles of
+// POLY_NEWTON_TILE, one step for the whole tile at a time. residual[i] is
+// |p(z_i)| over Horner's running error bound: at most 1 means z_i is a root
+// as far as double precision can tell.
+static inline void poly_newton_many(const double* a, size_t d, const double* zr, const double* zi, size_t m,
+                                    double* nr, double* ni, double* residual) {
+    for (size_t b = 0; b < m; b += POLY_NEWTON_TILE) {
+        size_t n = m - b < POLY_NEWTON_TILE ? m - b : POLY_NEWTON_TILE;
+        double xr[POLY_NEWTON_TILE], xi[POLY_NEWTON_TILE], ax[POLY_NEWTON_TILE], mu[POLY_NEWTON_TILE];
+        double pr[POLY_NEWTON_TILE], pi[POLY_NEWTON_TILE], dr[POLY_NEWTON_TILE], di[POLY_NEWTON_TILE];
+        double outside[POLY_NEWTON_TILE];  // 1 or 0, to pick coefficients without a branch
+        for (size_t i = 0; i < POLY_NEWTON_TILE; i++) {
+            size_t s = b + (i < n ? i : 0);  // a short tile repeats its first point
+            xr[i] = zr[s];
+            xi[i] = zi[s];
+            outside[i] = xr[i] * xr[i] + xi[i] * xi[i] > 1.0;
+            if (outside[i] != 0.0) poly_cdiv(1.0, 0.0, zr[s], zi[s], &xr[i], &xi[i]);
+            ax[i] = hypot(xr[i], xi[i]);
+            pr[i] = outside[i] != 0.0 ? a[0] : a[d];
+            pi[i] = dr[i] = di[i] = 0.0;
+            mu[i] = fabs(pr[i]) / 2;
+        }
+        for (size_t k = 1; k <= d; k++) {
+            double up = a[k], down = a[d - k];
+            for (size_t i = 0; i < POLY_NEWTON_TILE; i++) {
+                double t = dr[i] * xr[i] - di[i] * xi[i] + pr[i];
+                di[i] = dr[i] * xi[i] + di[i] * xr[i] + pi[i];
+                dr[i] = t;
+                t = pr[i] * xr[i] - pi[i] * xi[i] + outside[i] * up + (1.0 - outside[i]) * down;
+                pi[i] = pr[i] * xi[i] + pi[i] * xr[i];
+                pr[i] = t;
+                mu[i] = mu[i] * ax[i] + fabs(pr[i]) + fabs(pi[i]);
+            }
+        }
+        for (size_t i = 0; i < n; i++) {
+            residual[b + i] = hypot(pr[i], pi[i]) / (8 * DBL_EPSILON * mu[i]);
+            if (pr[i] == 0.0 && pi[i] == 0.0) {
+                nr[b + i] = ni[b + i] = 0.0;
+                continue;
+            }
+            // p/p' directly inside; outside, with x = 1/z and q the reversed
+            // polynomial, p/p' = z / (d - x q'(x)/q(x))
+            double fr = pr[i], fi = pi[i], gr = dr[i], gi = di[i];
+            if (outside[i] != 0.0) {
+                double tr, ti;
+                poly_cdiv(gr * xr[i] - gi * xi[i], gr * xi[i] + gi * xr[i], fr, fi, &tr, &ti);
+                gr = (double)d - tr;
+                gi = -ti;
+                fr = zr[b + i];
+                fi = zi[b + i];
+            }
+            if (gr == 0.0 && gi == 0.0) {  // a critical point: nudge off it
+                nr[b + i] = ni[b + i] = 1e-3 * (1.0 + hypot(zr[b + i], zi[b + i]));
+                continue;
+            }
+            poly_cdiv(fr, fi, gr, gi, &nr[b + i], &ni[b + i]);
+        }
+    }
+}
+
+// All deg p complex roots, with multiplicity, by Aberth-Ehrlich iteration,
+// written to re[] and im[] sorted by real then imaginary part. Returns the
+// degree, or (size_t)-1 for the zero polynomial, a non-finite coefficient
+// or no memory.
+//
+// Roots at 0 come straight from the lowest exponent. The rest start on the
+// circles given by the upper convex hull of (k, log|a_k|), the Newton
+// polygon, which puts as many guesses on each circle as the polynomial has
+// roots of about that modulus. Each sweep then moves every unconverged z_i
+// by w = N / (1 - N S), N the Newton correction and S the sum of
+// 1/(z_i - z_j) over the other roots. Every root is updated at once from
+// the previous sweep's values: each 1/(z_i - z_j) is formed once and counted
+// for both roots, and the Newton corrections come from poly_newton_many over
+// all unconverged roots together. A root stops moving once |p(z_i)| is
+// inside the rounding error of evaluating p there. Up to three Newton steps then polish every root, each
+// kept only if it shrinks that residual, and a root whose real part alone
+// passes the test is taken as real.
+static inline size_t poly_roots(const Polynomial* p, double* re, double* im) {
+    if (!p->count) return (size_t)-1;
+    size_t n = (size_t)p->terms[0].exponent;
+    size_t low = (size_t)p->terms[p->count - 1].exponent;
+    size_t d = n - low;
+    for (size_t i = 0; i < p->count; i++)
+        if (!isfinite(p->terms[i].coefficient)) return (size_t)-1;
+
+    double* a = (double*)calloc(d + 1, sizeof(double));
+    double* work = (double*)malloc((11 * d + 1) * sizeof(double));
+    size_t* index = (size_t*)malloc((d + 1) * sizeof(size_t));
+    unsigned char* done = (unsigned char*)calloc(d + 1, 1);
+    PolyRoot* sorted = (PolyRoot*)malloc((n ? n : 1) * sizeof(PolyRoot));
+    if (!a || !work || !index || !done || !sorted) {
+        free(a);
+        free(work);
+        free(index);
+        free(done);
+        free(sorted);
+        return (size_t)-1;
+    }
+    double *zr = work, *zi = work + d, *wr = work + 2 * d, *wi = work + 3 * d;
+    double *sr = work + 4 * d, *si = work + 5 * d;
+    double *gr = work + 6 * d, *gi = work + 7 * d, *nr = work + 8 * d, *ni = work + 9 * d, *res = work + 10 * d;
+    for (size_t i = 0; i < p->count; i++) a[(size_t)p->terms[i].exponent - low] = p->terms[i].coefficient;
+
+    if (d > 0) {
+        // Newton polygon: upper hull of the points (k, log|a_k|), a_k != 0
+        size_t h = 0;
+        for (size_t k = 0; k <= d; k++) {
+            if (a[k] == 0.0) continue;
+            double lk = log(fabs(a[k]));
+            while (h >= 2) {
+                size_t k0 = index[h - 2], k1 = index[h - 1];
+                double l0 = log(fabs(a[k0])), l1 = log(fabs(a[k1]));
+                if ((double)(k1 - k0) * (lk - l0) - (l1 - l0) * (double)(k - k0) < 0) break;
+                h--;
+            }
+            index[h++] = k;
+        }
+        const double two_pi = 6.283185307179586;
+        for (size_t s = 0; s + 1 < h; s++) {
+            size_t k0 = index[s], k1 = index[s + 1], m = k1 - k0;
+            double radius = exp((log(fabs(a[k0])) - log(fabs(a[k1]))) / (double)m);
+            for (size_t j = 0; j < m; j++) {
+                double angle = two_pi * ((double)j / (double)m + (double)k0 / (double)d) + 0.7;
+                zr[k0 + j] = radius * cos(angle);
+                zi[k0 + j] = radius * sin(angle);
+            }
+        }
+
+        size_t active = d;
+        for (int sweep = 0; sweep < POLY_ROOT_ITERATIONS && active; sweep++) {
+            for (size_t i = 0; i < d; i++) sr[i] = si[i] = 0.0;
+            for (size_t j = 0; j < d; j++) {
+                double ar = zr[j], ai = zi[j], tr = 0.0, ti = 0.0;
+                for (size_t i = j + 1; i < d; i++) {
+                    double er = zr[i] - ar, ei = zi[i] - ai;
+                    double q = 1.0 / (er * er + ei * ei);
+                    double ur = er * q, ui = ei * q;
+                    sr[i] += ur;
+                    si[i] -= ui;
+                    tr += ur;
+                    ti += ui;
+                }
+                sr[j] -= tr;
+                si[j] += ti;
+            }
+            size_t count = 0;
+            for (size_t i = 0; i < d; i++) {
+                wr[i] = wi[i] = 0.0;
+                if (done[i]) continue;
+                gr[count] = zr[i];
+                gi[count] = zi[i];
+                index[count++] = i;
+            }
+            poly_newton_many(a, d, gr, gi, count, nr, ni, res);
+            for (size_t t = 0; t < count; t++) {
+                size_t i = index[t];
+                if (res[t] <= 1.0) {
+                    done[i] = 1;
+                    active--;
+                    continue;
+                }
+                // w = N / (1 - N S)
+                double cr = 1.0 - (nr[t] * sr[i] - ni[t] * si[i]), ci = -(nr[t] * si[i] + ni[t] * sr[i]);
+                if ((cr == 0.0 && ci == 0.0) || !isfinite(cr) || !isfinite(ci)) {
+                    wr[i] = nr[t];
+                    wi[i] = ni[t];
+                } else {
+                    poly_cdiv(nr[t], ni[t], cr, ci, &wr[i], &wi[i]);
+                }
+            }
+            for (size_t i = 0; i < d; i++) {
+                zr[i] -= wr[i];
+                zi[i] -= wi[i];
+            }
+        }
+
+        // Polish: step every root to z - N while that lowers its residual
+        poly_newton_many(a, d, zr, zi, d, wr, wi, sr);
+        size_t polishing = d;
+        for (size_t i = 0; i < d; i++) index[i] = i;
+        for (int step = 0; step < 3 && polishing; step++) {
+            for (size_t t = 0; t < polishing; t++) {
+                gr[t] = zr[index[t]] - wr[index[t]];
+                gi[t] = zi[index[t]] - wi[index[t]];
+            }
+            poly_newton_many(a, d, gr, gi, polishing, nr, ni, res);
+            size_t kept = 0;
+            for (size_t t = 0; t < polishing; t++) {
+                size_t i = index[t];
+                if (!(res[t] < sr[i])) continue;
+                zr[i] = gr[t];
+                zi[i] = gi[t];
+                wr[i] = nr[t];
+                wi[i] = ni[t];
+                sr[i] = res[t];
+                index[kept++] = i;
+            }
+            polishing = kept;
+        }
+        for (size_t i = 0; i < d; i++) gi[i] = 0.0;
+        poly_newton_many(a, d, zr, gi, d, nr, ni, res);
+        for (size_t i = 0; i < d; i++)
+            if (res[i] <= 1.0) zi[i] = 0.0;
+    }
+
+    for (size_t i = 0; i < d; i++) {
+        sorted[i].re = zr[i];
+        sorted[i].im = zi[i];
+    }
+    for (size_t i = d; i < n; i++) sorted[i].re = sorted[i].im = 0.0;
+    if (n > 1) qsort(sorted, n, sizeof(PolyRoot), poly_compare_roots);
+    for (size_t i = 0; i < n; i++) {
+        re[i] = sorted[i].re;
+        im[i] = sorted[i].im;
+    }
+    free(a);
+    free(work);
+    free(index);
+    free(done);
+    free(sorted);
+    return n;
+}
+
+// Writes p as "3x^2-2x+1" (or "0") into size wide characters. Like snprintf,
+// returns the length of the whole text; if that is size or more, output holds
+// only the leading terms that fit.
+static inline size_t poly_to_string(const Polynomial* p, wchar_t* output, size_t size) {
+    size_t used = 0, total = 0;
+    if (size) output[0] = L'\0';
+    for (size_t i = 0; i < p->count; i++) {
+        wchar_t term[64];
+        double c = p->terms[i].coefficient;
+        int e = p->terms[i].exponent;
+        const wchar_t* sign = c < 0 ? L"-" : (i > 0 ? L"+" : L"");
+        double m = c < 0 ? -c : c;
+        wchar_t coefficient[32] = L"";
+        if (e == 0 || m != 1.0) swprintf(coefficient, 32, L"%g", m);
+        if (e == 0)
+            swprintf(term, 64, L"%ls%ls", sign, coefficient);
+        else if (e == 1)
+            swprintf(term, 64, L"%ls%lsx", sign, coefficient);
+        else
+            swprintf(term, 64, L"%ls%lsx^%d", sign, coefficient, e);
+        size_t len = wcslen(term);
+        if (used == total && used + len < size) {
+            memcpy(output + used, term, (len + 1) * sizeof(wchar_t));
+            used += len;
+        }
+        total += len;
+    }
+    if (total == 0) {
+        if (size > 1) wcscpy(output, L"0");
+        return 1;
+    }
+    return total;
+}
+
+#endif
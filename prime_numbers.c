@@ -1,53 +1,66 @@
 #include <stdio.h>
 #include <stdbool.h>
-#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "prime_sieve.h"
 
-#define MAX_RANGE 1000
+#define MAX_RANGE 1000000000000ULL
 
-void find_primes(int n) {
-    bool is_prime[MAX_RANGE + 1];
-    
-    // Initialize all numbers as prime
-    for (int i = 0; i <= n; i++) {
-        is_prime[i] = true;
+// Prints the primes up to n one segment at a time, so memory stays at one
+// L1-sized segment plus the sieving primes below sqrt(n)
+int find_primes(uint64_t n) {
+    uint32_t* base;
+    size_t base_count = wheel_base_primes(wheel_isqrt(n) < 19 ? 19 : wheel_isqrt(n), &base);
+    wheel_sieve* sieve = (wheel_sieve*)malloc(sizeof(wheel_sieve));
+    if (base_count == (size_t)-1 || !sieve || !wheel_sieve_init(sieve, base, base_count, 0)) {
+        printf("Out of memory.\n");
+        free(base);
+        free(sieve);
+        return 1;
     }
-    
-    // 0 and 1 are not prime
-    is_prime[0] = is_prime[1] = false;
-    
-    // Sieve of Eratosthenes algorithm
-    for (int p = 2; p * p <= n; p++) {
-        if (is_prime[p]) {
-            // Mark multiples of p as not prime
-            for (int i = p * p; i <= n; i += p) {
-                is_prime[i] = false;
-            }
-        }
+
+    uint64_t count = 0;
+    printf("Prime numbers up to %llu are:\n", (unsigned long long)n);
+    for (unsigned p = 2; p <= 5 && p <= n; p += p == 2 ? 1 : 2) {
+        printf("%u ", p);
+        count++;
     }
-    
-    // Print prime numbers
-    printf("Prime numbers up to %d are:\n", n);
-    for (int p = 2; p <= n; p++) {
-        if (is_prime[p]) {
-            printf("%d ", p);
+    uint64_t total_bytes = n / 30 + 1;
+    while (sieve->start < total_bytes) {
+        uint64_t first = sieve->start;
+        uint64_t left = total_bytes - first;
+        uint32_t bytes = left < WHEEL_SEGMENT_BYTES ? (uint32_t)left : WHEEL_SEGMENT_BYTES;
+        wheel_sieve_next(sieve, bytes);
+        for (uint32_t i = 0; i < bytes; i++) {
+            for (int j = 0; j < 8; j++) {
+                uint64_t p = 30 * (first + i) + wheel_residues[j];
+                if (p > n) break;
+                if (sieve->bits[i] >> j & 1) {
+                    printf("%llu ", (unsigned long long)p);
+                    count++;
+                }
+            }
         }
     }
-    printf("\n");
+    printf("\n%llu primes\n", (unsigned long long)count);
+
+    wheel_sieve_free(sieve);
+    free(sieve);
+    free(base);
+    return 0;
 }
 
 int main() {
-    int range;
-    
-    printf("Enter the range to find prime numbers (max %d): ", MAX_RANGE);
-    scanf("%d", &range);
-    
+    unsigned long long range;
+
+    printf("Enter the range to find prime numbers (max %llu): ", MAX_RANGE);
+    if (scanf("%llu", &range) != 1) range = 0;
+
     // Validate input
     if (range < 2 || range > MAX_RANGE) {
-        printf("Invalid range. Please enter a number between 2 and %d.\n", MAX_RANGE);
+        printf("Invalid range. Please enter a number between 2 and %llu.\n", MAX_RANGE);
         return 1;
     }
-    
-    find_primes(range);
-    
-    return 0;
+
+    return find_primes(range);
 }
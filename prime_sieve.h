@@ -0,0 +1,180 @@
+// Segmented sieve of Eratosthenes on a mod-30 wheel, shared by prime_numbers.c
+// and the expression engine. Past 5 only the 8 residues coprime to 30 can be
+// prime, so byte b of the sieve holds one bit for each of 30b + 1, 30b + 7,
+// ..., 30b + 29. A segment of WHEEL_SEGMENT_BYTES covers 983040 numbers and
+// fits in the L1 data cache. Each sieving prime p crosses out its multiples
+// p q with q coprime to 30 as 8 progressions of stride p bytes, each clearing
+// one fixed bit, and carries its place from one segment to the next; the
+// multiples of 7, 11, 13 and 17 are copied in from a precomputed pattern.
+#ifndef PRIME_SIEVE_H
+#define PRIME_SIEVE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "prime_table.h"
+
+#define WHEEL_SEGMENT_BYTES 32768
+
+// 7 * 11 * 13 * 17: the pattern of the pre-sieved primes repeats every this many bytes
+#define WHEEL_PATTERN_BYTES 17017
+
+static const unsigned char wheel_residues[8] = {1, 7, 11, 13, 17, 19, 23, 29};
+
+// Bit of residue r mod 30 within a byte, or 8 when r shares a factor with 30
+static const unsigned char wheel_bit[30] = {
+    8, 0, 8, 8, 8, 8, 8, 1, 8, 8, 8, 2, 8, 3, 8,
+    8, 8, 4, 8, 5, 8, 8, 8, 6, 8, 8, 8, 8, 8, 7
+};
+
+// A sieving prime and, for each of its progressions, the next byte to clear
+// relative to the start of the next segment
+typedef struct {
+    uint32_t prime;
+    uint32_t next[8];
+    unsigned char mask[8];
+} wheel_prime;
+
+// Segment state. Each thread sieving its own run of segments owns one.
+typedef struct {
+    const uint32_t* base;    // sieving primes from 19 up, ascending (wheel_base_primes)
+    size_t base_count;
+    wheel_prime* active;     // the base primes whose square lies below the current segment end
+    size_t active_count;
+    unsigned char* pattern;  // WHEEL_PATTERN_BYTES bytes with the multiples of 7 to 17 cleared
+    uint64_t start;          // first byte of the next segment
+    unsigned char bits[WHEEL_SEGMENT_BYTES];
+} wheel_sieve;
+
+// Primes 19 <= p <= limit, enough to sieve up to limit^2, into a malloc'd
+// array; returns the count, or (size_t)-1 when out of memory
+static inline size_t wheel_base_primes(uint32_t limit, uint32_t** out) {
+    bool* is_prime = (bool*)malloc((size_t)limit + 1);
+    size_t count = 0;
+    *out = NULL;
+    if (!is_prime) return (size_t)-1;
+    sieve_primes(is_prime, (int)limit);
+    for (uint32_t p = 19; p <= limit; p++) count += is_prime[p];
+    *out = (uint32_t*)malloc((count ? count : 1) * sizeof(uint32_t));
+    if (!*out) {
+        free(is_prime);
+        return (size_t)-1;
+    }
+    count = 0;
+    for (uint32_t p = 19; p <= limit; p++)
+        if (is_prime[p]) (*out)[count++] = p;
+    free(is_prime);
+    return count;
+}
+
+// Largest r with r * r <= n
+static inline uint32_t wheel_isqrt(uint64_t n) {
+    uint64_t r = 0;
+    for (uint64_t bit = (uint64_t)1 << 31; bit; bit >>= 1)
+        if ((r + bit) * (r + bit) <= n) r += bit;
+    return (uint32_t)r;
+}
+
+// Places p's progressions at the first multiple p q >= max(p^2, 30 start)
+static inline void wheel_prime_init(wheel_prime* w, uint32_t p, uint64_t start) {
+    uint64_t lo = 30 * start;
+    uint64_t q0 = (lo + p - 1) / p;
+    if (q0 < p) q0 = p;
+    w->prime = p;
+    for (int j = 0; j < 8; j++) {
+        uint64_t q = q0 + (wheel_residues[j] + 30 - q0 % 30) % 30;
+        w->next[j] = (uint32_t)((p * q - lo) / 30);
+        w->mask[j] = (unsigned char)~(1u << wheel_bit[(uint64_t)p * wheel_residues[j] % 30]);
+    }
+}
+
+// Prepares s to sieve segments from byte `start` on (numbers from 30 start);
+// returns false when out of memory
+static inline bool wheel_sieve_init(wheel_sieve* s, const uint32_t* base, size_t base_count, uint64_t start) {
+    s->base = base;
+    s->base_count = base_count;
+    s->active_count = 0;
+    s->start = start;
+    s->active = (wheel_prime*)malloc((base_count ? base_count : 1) * sizeof(wheel_prime));
+    s->pattern = (unsigned char*)malloc(WHEEL_PATTERN_BYTES);
+    if (!s->active || !s->pattern) {
+        free(s->active);
+        free(s->pattern);
+        return false;
+    }
+    for (uint32_t b = 0; b < WHEEL_PATTERN_BYTES; b++) {
+        unsigned char byte = 0;
+        for (int j = 0; j < 8; j++) {
+            uint32_t n = 30 * b + wheel_residues[j];
+            if (n % 7 && n % 11 && n % 13 && n % 17) byte |= (unsigned char)(1u << j);
+        }
+        s->pattern[b] = byte;
+    }
+    return true;
+}
+
+static inline void wheel_sieve_free(wheel_sieve* s) {
+    free(s->active);
+    free(s->pattern);
+}
+
+// Sieves the next `bytes` (at most WHEEL_SEGMENT_BYTES) bytes into s->bits:
+// afterwards bit j of s->bits[i] is set when 30 (start + i) + wheel_residues[j]
+// is prime, start being s->start before the call. The base primes must reach
+// the square root of the segment's last number.
+static inline void wheel_sieve_next(wheel_sieve* s, uint32_t bytes) {
+    uint64_t end = 30 * (s->start + bytes);
+    size_t offset = (size_t)(s->start % WHEEL_PATTERN_BYTES);
+    for (uint32_t i = 0; i < bytes;) {
+        size_t run = WHEEL_PATTERN_BYTES - offset;
+        if (run > bytes - i) run = bytes - i;
+        memcpy(s->bits + i, s->pattern + offset, run);
+        i += (uint32_t)run;
+        offset = 0;
+    }
+    if (s->start == 0) s->bits[0] = 0xfe;  // 7, 11, 13 and 17 themselves, but not 1
+
+    while (s->active_count < s->base_count &&
+           (uint64_t)s->base[s->active_count] * s->base[s->active_count] < end) {
+        wheel_prime_init(&s->active[s->active_count], s->base[s->active_count], s->start);
+        s->active_count++;
+    }
+    for (size_t i = 0; i < s->active_count; i++) {
+        wheel_prime* w = &s->active[i];
+        uint32_t p = w->prime;
+        for (int j = 0; j < 8; j++) {
+            uint32_t k = w->next[j];
+            unsigned char mask = w->mask[j];
+            for (; k < bytes; k += p) s->bits[k] &= mask;
+            w->next[j] = k - bytes;
+        }
+    }
+    s->start += bytes;
+}
+
+// Bits of a sieve byte whose numbers do not exceed 30 b + r, for 0 <= r < 30
+static inline unsigned char wheel_keep_mask(unsigned r) {
+    unsigned char mask = 0;
+    for (int j = 0; j < 8 && wheel_residues[j] <= r; j++) mask |= (unsigned char)(1u << j);
+    return mask;
+}
+
+// Set bits in bits[0..bytes)
+static inline uint64_t wheel_count(const unsigned char* bits, size_t bytes) {
+    uint64_t total = 0;
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t x;
+        memcpy(&x, bits + i, 8);
+        x = x - ((x >> 1) & 0x5555555555555555ull);
+        x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+        x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+        total += (x * 0x0101010101010101ull) >> 56;
+    }
+    for (; i < bytes; i++)
+        for (unsigned char b = bits[i]; b; b &= (unsigned char)(b - 1)) total++;
+    return total;
+}
+
+#endif
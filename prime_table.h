@@ -0,0 +1,49 @@
+// Small primes and the sieve of Eratosthenes, shared by prime_numbers.c and
+// the expression engine, which trial-divides by the table before running
+// Miller-Rabin or Pollard's rho
+#ifndef PRIME_TABLE_H
+#define PRIME_TABLE_H
+
+#include <stdbool.h>
+
+#define SMALL_PRIME_LIMIT 1000
+#define SMALL_PRIME_COUNT 168
+
+// Every prime below SMALL_PRIME_LIMIT, in order
+static const unsigned short small_primes[SMALL_PRIME_COUNT] = {
+    2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43,
+    47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107,
+    109, 113, 127, 131, 137, 139, 149, 151, 157, 163, 167, 173, 179, 181,
+    191, 193, 197, 199, 211, 223, 227, 229, 233, 239, 241, 251, 257, 263,
+    269, 271, 277, 281, 283, 293, 307, 311, 313, 317, 331, 337, 347, 349,
+    353, 359, 367, 373, 379, 383, 389, 397, 401, 409, 419, 421, 431, 433,
+    439, 443, 449, 457, 461, 463, 467, 479, 487, 491, 499, 503, 509, 521,
+    523, 541, 547, 557, 563, 569, 571, 577, 587, 593, 599, 601, 607, 613,
+    617, 619, 631, 641, 643, 647, 653, 659, 661, 673, 677, 683, 691, 701,
+    709, 719, 727, 733, 739, 743, 751, 757, 761, 769, 773, 787, 797, 809,
+    811, 821, 823, 827, 829, 839, 853, 857, 859, 863, 877, 881, 883, 887,
+    907, 911, 919, 929, 937, 941, 947, 953, 967, 971, 977, 983, 991, 997
+};
+
+// Sieve of Eratosthenes: is_prime[i] for 0 <= i <= n
+static inline void sieve_primes(bool is_prime[], int n) {
+    // Initialize all numbers as prime
+    for (int i = 0; i <= n; i++) {
+        is_prime[i] = true;
+    }
+
+    // 0 and 1 are not prime
+    is_prime[0] = false;
+    if (n >= 1) is_prime[1] = false;
+
+    for (int p = 2; p * p <= n; p++) {
+        if (is_prime[p]) {
+            // Mark multiples of p as not prime
+            for (int i = p * p; i <= n; i += p) {
+                is_prime[i] = false;
+            }
+        }
+    }
+}
+
+#endif
@@ -1,24 +1,11 @@
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
-
-// Verbose mode for detailed sorting steps
-#define VERBOSE 0
-
-// Generic swap macro for any type
-#define SWAP(type, a, b) \
-    do { \
-        type temp = (a); \
-        (a) = (b); \
-        (b) = temp; \
-    } while(0)
+#include "sort.h"
 
 // Print array with optional message
 void printArray(int arr[], int size, const char* message, bool force_print) {
-    #if VERBOSE
-    force_print = true;
-    #endif
-
     if (force_print) {
         printf("%s: ", message ? message : "Array");
         for (int i = 0; i < size; i++) {
@@ -28,75 +15,50 @@ void printArray(int arr[], int size, const char* message, bool force_print) {
     }
 }
 
-// Partition function with improved error handling
-int partition(int arr[], int low, int high) {
-    // Validate input
-    if (low >= high) return low;
-
-    int pivot = arr[high];
-    printArray(arr + low, high - low + 1, "Current subarray", false);
-    
-    int i = low - 1;
-
-    for (int j = low; j < high; j++) {
-        if (arr[j] < pivot) {
-            i++;
-            SWAP(int, arr[i], arr[j]);
-            printArray(arr + low, high - low + 1, "After swap", false);
-        }
-    }
-
-    SWAP(int, arr[i + 1], arr[high]);
-    printArray(arr + low, high - low + 1, "After partition", false);
-    return i + 1;
-}
-
-// Quicksort with improved error handling and optional recursion limit
-void quicksort(int arr[], int low, int high, int depth_limit) {
-    // Prevent excessive recursion
-    if (depth_limit <= 0) {
-        // Fallback to insertion sort for small subarrays
-        for (int i = low + 1; i <= high; i++) {
-            int key = arr[i];
-            int j = i - 1;
-            while (j >= low && arr[j] > key) {
-                arr[j + 1] = arr[j];
-                j--;
-            }
-            arr[j + 1] = key;
+// Print a double array, eliding the middle of long ones
+void printDoubles(const double arr[], size_t size, const char* message) {
+    printf("%s: ", message);
+    for (size_t i = 0; i < size; i++) {
+        if (size > 10 && i == 5) {
+            printf("... ");
+            i = size - 5;
         }
-        return;
-    }
-
-    if (low < high) {
-        #if VERBOSE
-        printf("\nQuicksorting subarray from index %d to %d\n", low, high);
-        #endif
-
-        int pivot = partition(arr, low, high);
-
-        // Recursive calls with reduced depth limit
-        quicksort(arr, low, pivot - 1, depth_limit - 1);
-        quicksort(arr, pivot + 1, high, depth_limit - 1);
+        printf("%g ", arr[i]);
     }
+    printf("\n");
 }
 
-// Main function demonstrating quicksort usage
+// Main function demonstrating the sorts in sort.h
 int main() {
     int arr[] = {5, 2, 9, 1, 7, 3, 8, 4, 6};
     int n = sizeof(arr) / sizeof(arr[0]);
 
-    // Calculate depth limit to prevent worst-case scenarios
-    int depth_limit = 2 * (int)(sizeof(int) * 8 - __builtin_clz(n));
-
     printf("Original array: ");
     printArray(arr, n, "Before sorting", true);
 
-    // Sort the array
-    quicksort(arr, 0, n - 1, depth_limit);
+    // Introsort: median-of-3 quicksort, heap sort past 2 log2 n levels
+    introsort_ints(arr, (size_t)n);
 
     printf("\nFinal sorted array: ");
     printArray(arr, n, "After sorting", true);
 
+    // Radix sort for doubles, negatives and NaN included
+    size_t count = 100000;
+    double* values = (double*)malloc(count * sizeof(double));
+    if (!values) {
+        printf("Out of memory.\n");
+        return 1;
+    }
+    unsigned long long state = 12345;
+    for (size_t i = 0; i < count; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        values[i] = (double)(long long)(state >> 20) / 1e9 - 4096.0;
+    }
+    values[count / 2] = NAN;
+    sort_doubles(values, count);
+    printf("\n");
+    printDoubles(values, count, "Sorted doubles");
+
+    free(values);
     return 0;
 }
@@ -0,0 +1,242 @@
+// Sorting shared by quicksort.c and the expression engine (sort, median,
+// percentile). SORT_DEFINE instantiates an introsort and an introselect for
+// any element type and ordering; sort_doubles_radix is an LSD radix sort on
+// the bit patterns of IEEE doubles, and sort_doubles picks between the two.
+// Threads are left to the caller: the engine sorts one run per thread with
+// these and merges the runs.
+#ifndef SORT_H
+#define SORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Ranges this short are finished by insertion sort
+#define SORT_INSERTION_MAX 24
+
+// Below this many doubles sort_doubles uses introsort rather than radix sort
+#define SORT_RADIX_MIN 1024
+
+// Generic swap macro for any type
+#define SORT_SWAP(type, a, b) \
+    do { \
+        type sort_swap_tmp = (a); \
+        (a) = (b); \
+        (b) = sort_swap_tmp; \
+    } while (0)
+
+// Orderings for SORT_DEFINE. SORT_DOUBLE_LESS puts NaN after everything
+// else, as sort_doubles_radix does, so that it is a strict weak ordering.
+#define SORT_LESS(x, y) ((x) < (y))
+#define SORT_DOUBLE_LESS(x, y) ((x) < (y) || ((y) != (y) && (x) == (x)))
+
+// floor(log2(n)) for n >= 1
+static inline int sort_log2(size_t n) {
+    int r = 0;
+    while (n >>= 1) r++;
+    return r;
+}
+
+// SORT_DEFINE(name, type, less) defines, for `less` a strict weak ordering:
+//   void name(type* a, size_t n)                    sorts a[0..n)
+//   void name##_select(type* a, size_t n, size_t k) puts the k-th smallest
+//       at a[k], with nothing greater before it and nothing smaller after
+//
+// Both partition around the median of the first, middle and last elements
+// with Hoare's scheme, where those three also stop the scans, so no bounds
+// checks are needed. Past 2 log2 n levels the remaining range is heap
+// sorted, bounding the worst case by O(n log n). The sort recurses into the
+// smaller side and loops on the larger, so the stack stays O(log n), and
+// leaves each range of SORT_INSERTION_MAX or fewer to insertion sort.
+#define SORT_DEFINE(name, type, less) \
+    static inline void name##_insertion(type* a, size_t n) { \
+        for (size_t i = 1; i < n; i++) { \
+            type key = a[i]; \
+            size_t j = i; \
+            while (j > 0 && less(key, a[j - 1])) { \
+                a[j] = a[j - 1]; \
+                j--; \
+            } \
+            a[j] = key; \
+        } \
+    } \
+    \
+    static inline void name##_sift(type* a, size_t root, size_t n) { \
+        type value = a[root]; \
+        for (size_t child; (child = 2 * root + 1) < n; root = child) { \
+            if (child + 1 < n && less(a[child], a[child + 1])) child++; \
+            if (!less(value, a[child])) break; \
+            a[root] = a[child]; \
+        } \
+        a[root] = value; \
+    } \
+    \
+    static inline void name##_heapsort(type* a, size_t n) { \
+        for (size_t i = n / 2; i-- > 0;) name##_sift(a, i, n); \
+        for (size_t end = n; end-- > 1;) { \
+            SORT_SWAP(type, a[0], a[end]); \
+            name##_sift(a, 0, end); \
+        } \
+    } \
+    \
+    /* Splits a[0..n), n >= 3, at s in [1, n): a[0..s) <= pivot <= a[s..n) */ \
+    static inline size_t name##_partition(type* a, size_t n) { \
+        size_t mid = n / 2; \
+        if (less(a[mid], a[0])) SORT_SWAP(type, a[mid], a[0]); \
+        if (less(a[n - 1], a[mid])) { \
+            SORT_SWAP(type, a[n - 1], a[mid]); \
+            if (less(a[mid], a[0])) SORT_SWAP(type, a[mid], a[0]); \
+        } \
+        type pivot = a[mid]; \
+        size_t i = 0, j = n - 1; \
+        for (;;) { \
+            do i++; while (less(a[i], pivot)); \
+            do j--; while (less(pivot, a[j])); \
+            if (i >= j) return j + 1; \
+            SORT_SWAP(type, a[i], a[j]); \
+        } \
+    } \
+    \
+    static inline void name##_loop(type* a, size_t n, int depth) { \
+        while (n > SORT_INSERTION_MAX) { \
+            if (depth-- == 0) { \
+                name##_heapsort(a, n); \
+                return; \
+            } \
+            size_t s = name##_partition(a, n); \
+            if (s < n - s) { \
+                name##_loop(a, s, depth); \
+                a += s; \
+                n -= s; \
+            } else { \
+                name##_loop(a + s, n - s, depth); \
+                n = s; \
+            } \
+        } \
+        name##_insertion(a, n); \
+    } \
+    \
+    static inline void name(type* a, size_t n) { \
+        if (n > 1) name##_loop(a, n, 2 * sort_log2(n)); \
+    } \
+    \
+    static inline void name##_select(type* a, size_t n, size_t k) { \
+        int depth = n > 1 ? 2 * sort_log2(n) : 0; \
+        while (n > SORT_INSERTION_MAX) { \
+            if (depth-- == 0) { \
+                name##_heapsort(a, n); \
+                return; \
+            } \
+            size_t s = name##_partition(a, n); \
+            if (k < s) { \
+                n = s; \
+            } else { \
+                a += s; \
+                n -= s; \
+                k -= s; \
+            } \
+        } \
+        name##_insertion(a, n); \
+    }
+
+SORT_DEFINE(introsort_ints, int, SORT_LESS)
+SORT_DEFINE(introsort_doubles, double, SORT_DOUBLE_LESS)
+
+// Unsigned key with the same order as the double: negatives have every bit
+// flipped, the rest only the sign bit, and any NaN goes past +inf
+static inline uint64_t sort_double_key(double x) {
+    uint64_t u;
+    memcpy(&u, &x, sizeof u);
+    if (x != x) return UINT64_MAX;
+    return (u >> 63) ? ~u : u | 0x8000000000000000ull;
+}
+
+// Inverse of sort_double_key; UINT64_MAX comes back as a quiet NaN
+static inline double sort_double_from_key(uint64_t k) {
+    uint64_t u = (k >> 63) ? k & 0x7fffffffffffffffull : ~k;
+    double x;
+    if (k == UINT64_MAX) u = 0x7ff8000000000000ull;
+    memcpy(&x, &u, sizeof x);
+    return x;
+}
+
+// Radix sort digits: six of 11 bits cover the 64-bit key
+#define SORT_RADIX_BITS 11
+#define SORT_RADIX_PASSES 6
+
+// Keys live in the doubles' own storage while radix sort runs
+static inline uint64_t sort_load_key(const double* p) {
+    uint64_t k;
+    memcpy(&k, p, sizeof k);
+    return k;
+}
+
+static inline void sort_store_key(double* p, uint64_t k) {
+    memcpy(p, &k, sizeof k);
+}
+
+// LSD radix sort of a[0..n), using scratch[0..n). The doubles are turned
+// into sort_double_key values in place, one read builds every digit's
+// histogram, and each pass scatters the keys stably between the two
+// buffers before they are turned back. A digit every key shares, such as
+// the top of the exponent for data of one sign and scale, costs no pass.
+// -0 sorts before +0, as its key is smaller; the sort is stable for equal
+// keys; NaNs lose their payload. Falls back to introsort if the histograms
+// cannot be allocated.
+static inline void sort_doubles_radix(double* a, double* scratch, size_t n) {
+    enum { buckets = 1 << SORT_RADIX_BITS, mask = buckets - 1 };
+    size_t(*count)[buckets] = (size_t(*)[buckets])calloc(SORT_RADIX_PASSES, sizeof *count);
+    if (!count) {
+        introsort_doubles(a, n);
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint64_t k = sort_double_key(a[i]);
+        sort_store_key(&a[i], k);
+        for (int d = 0; d < SORT_RADIX_PASSES; d++) count[d][(k >> (SORT_RADIX_BITS * d)) & mask]++;
+    }
+    double* src = a;
+    double* dst = scratch;
+    for (int d = 0; d < SORT_RADIX_PASSES && n; d++) {
+        size_t* c = count[d];
+        int shift = SORT_RADIX_BITS * d;
+        if (c[(sort_load_key(src) >> shift) & mask] == n) continue;
+        size_t offset = 0;
+        for (int b = 0; b < buckets; b++) {
+            size_t t = c[b];
+            c[b] = offset;
+            offset += t;
+        }
+        for (size_t i = 0; i < n; i++) {
+            uint64_t k = sort_load_key(&src[i]);
+            sort_store_key(&dst[c[(k >> shift) & mask]++], k);
+        }
+        double* t = src;
+        src = dst;
+        dst = t;
+    }
+    for (size_t i = 0; i < n; i++) a[i] = sort_double_from_key(sort_load_key(&src[i]));
+    free(count);
+}
+
+// Sorts a[0..n) ascending with NaN last: introsort for short arrays, radix
+// sort otherwise. Returns false only when radix sort's scratch could not be
+// allocated, after falling back to introsort.
+static inline bool sort_doubles(double* a, size_t n) {
+    if (n < SORT_RADIX_MIN) {
+        introsort_doubles(a, n);
+        return true;
+    }
+    double* scratch = (double*)malloc(n * sizeof(double));
+    if (!scratch) {
+        introsort_doubles(a, n);
+        return false;
+    }
+    sort_doubles_radix(a, scratch, n);
+    free(scratch);
+    return true;
+}
+
+#endif
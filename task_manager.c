@@ -1,13 +1,48 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "sort.h"
+
 #define MAX_TASK_DESC 100
-#define MAX_LINE 150
 #define MAX_STATUS 20
 
+// Descriptions read back from the snapshot or journal may run to this many
+// bytes; only typed-in ones are held to MAX_TASK_DESC
+#define MAX_STORED_DESC 65535
+
+// Snapshots smaller than this per thread are loaded on fewer threads
+#define LOAD_CHUNK_BYTES (1 << 20)
+
+// Persistence: tasks.txt is a snapshot and every change since is appended
+// to the journal. Compaction moves the journal aside, writes a new snapshot
+// in the background, and then deletes the old journal.
+#define TASKS_FILE "tasks.txt"
+#define SNAPSHOT_TMP_FILE "tasks.txt.tmp"
+#define JOURNAL_FILE "tasks.journal"
+#define JOURNAL_OLD_FILE "tasks.journal.old"
+
+// The journal is fsynced once this many records or seconds have built up
+#define JOURNAL_SYNC_RECORDS 32
+#define JOURNAL_SYNC_SECONDS 2
+
+// Compact once the journal is larger than both this and the last snapshot
+#define JOURNAL_COMPACT_BYTES (1L << 20)
+
 // Improved error handling macro
 #define HANDLE_MEMORY_ERROR(ptr) \
     do { \
@@ -17,27 +52,158 @@
         } \
     } while(0)
 
-// Structure for a task
+// Flush a file through to the disk; returns 0 on failure
+static int syncFile(FILE* file) {
+    if (fflush(file) != 0) return 0;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// Rename from over to, replacing it atomically; returns 0 on failure
+static int replaceFile(const char* from, const char* to) {
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+// Threads for compaction and loading. THREAD_FUNC declares a ThreadBody
+// taking one pointer; startThread returns 0 if no thread could be made.
+#ifdef _WIN32
+typedef HANDLE ThreadHandle;
+typedef LPTHREAD_START_ROUTINE ThreadBody;
+#define THREAD_FUNC(name, arg) DWORD WINAPI name(LPVOID arg)
+#else
+typedef pthread_t ThreadHandle;
+typedef void* (*ThreadBody)(void*);
+#define THREAD_FUNC(name, arg) void* name(void* arg)
+#endif
+
+static int startThread(ThreadHandle* thread, ThreadBody body, void* arg) {
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, body, arg, 0, NULL);
+    return *thread != NULL;
+#else
+    return pthread_create(thread, NULL, body, arg) == 0;
+#endif
+}
+
+static void joinThread(ThreadHandle thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+static size_t cpuCount() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (size_t)n : 1;
+#endif
+}
+
+// A task going into or coming out of the store, which keeps no Task
+// records of its own. The description and status point at the caller's
+// text or at the store's; the store's are good until it next changes.
 typedef struct Task {
     int id;
-    char description[MAX_TASK_DESC];
+    const char* description;
+    size_t descLength;
     int priority;
-    char status[MAX_STATUS];
-    char date[11];
-    struct Task* next;
+    const char* status;
+    uint32_t date;           // YYYYMMDD, 0 if unknown
 } Task;
 
+// A status seen in the store, with the bitmap of slots holding it. A
+// task's status is stored as its index in this table.
+typedef struct StatusBits {
+    char name[MAX_STATUS];
+    uint64_t* bits;
+} StatusBits;
+
+// A slot with its date index key: the date in the high half, and the id,
+// offset to sort as unsigned, in the low half
+typedef struct DateEntry {
+    uint64_t key;
+    uint32_t slot;
+} DateEntry;
+
+// Tasks are stored as columns, one array per field indexed by slot, so a
+// scan over a field reads only that field. Priorities take a byte, dates
+// are packed as YYYYMMDD, and statuses are interned in the statuses table.
+// Descriptions are NUL-terminated in one arena, found by offset; a deleted
+// task's description stays there as garbage until the arena next fills up
+// and is copied. Deleting a task moves the last task into its slot.
+//
+// The hash index maps an id to its slot by open addressing with linear
+// probing, kept at most half full. The heap orders the slots by priority,
+// then id, for the ordered views; heapPos[slot] is the slot's place in it,
+// so any task can be removed in O(log n). For queries there is a bitmap of
+// slots per priority and per status, kept up to date, and byDate, every
+// slot sorted by date, then id. A change only marks byDate stale; the next
+// query that needs it re-sorts it, so a run of changes such as a journal
+// replay costs one sort rather than a shift per change. Slots are 32-bit.
+typedef struct TaskStore {
+    size_t count;
+    size_t capacity;
+    int* ids;
+    uint8_t* priorities;
+    uint16_t* statusCodes;   // index into statuses
+    uint32_t* dates;         // YYYYMMDD
+    uint32_t* descOffsets;   // into arena
+    char* arena;
+    size_t arenaUsed;
+    size_t arenaCapacity;
+    size_t arenaGarbage;     // bytes no task's description uses
+    uint32_t* index;         // slot of each entry, or EMPTY_SLOT
+    size_t indexMask;        // index capacity - 1, a power of two
+    uint32_t* heap;          // slots, min-heap on (priority, id)
+    uint32_t* heapPos;
+    uint64_t* priorityBits[5];
+    StatusBits* statuses;
+    size_t statusCount;
+    uint32_t* byDate;
+    int byDateStale;
+} TaskStore;
+
+#define EMPTY_SLOT UINT32_MAX
+
+#define SET_BIT(bits, slot) ((bits)[(slot) / 64] |= 1ULL << ((slot) % 64))
+#define CLEAR_BIT(bits, slot) ((bits)[(slot) / 64] &= ~(1ULL << ((slot) % 64)))
+#define TEST_BIT(bits, slot) ((bits)[(slot) / 64] >> ((slot) % 64) & 1)
+
 // Global variables
-Task* taskList = NULL;
+TaskStore store = {0};
 int nextId = 1;
 
 // Function prototypes (moved to top for full declaration)
 char* getCurrentDate();
-Task* createTask(int id, const char* desc, int priority, const char* status, const char* date);
+int createTask(Task* task, int id, const char* desc, size_t descLength, int priority, const char* status, const char* date);
+size_t findSlot(int id);
+Task taskAt(size_t slot);
+void insertTask(const Task* task);
+int removeTask(int id);
+void rebuildIndexes();
+void setTaskStatus(size_t slot, const char* status);
+void queryTasks();
 void trimWhitespace(char* str);
 int validateInput(const char* input, int maxLen);
-void saveToFile();
+long saveToFile(const char* path, const TaskStore* tasks);
 void loadFromFile();
+void journalPut(const Task* task);
+void journalDelete(int id);
+void closeJournal();
+void freeStore(TaskStore* tasks);
 void clearTaskList();
 void viewTasks();
 void addTask();
@@ -88,61 +254,492 @@ char* getCurrentDate() {
     return date;
 }
 
-// Create a new task with enhanced error checking
-Task* createTask(int id, const char* desc, int priority, const char* status, const char* date) {
+// Pack "YYYY-MM-DD", len bytes long, into YYYYMMDD; anything else packs to 0
+static uint32_t packDate(const char* date, size_t len) {
+    uint32_t packed = 0;
+    if (len != 10) return 0;
+    for (int i = 0; i < 10; i++) {
+        if (i == 4 || i == 7) {
+            if (date[i] != '-') return 0;
+        } else if (isdigit((unsigned char)date[i])) {
+            packed = packed * 10 + (uint32_t)(date[i] - '0');
+        } else {
+            return 0;
+        }
+    }
+    return packed;
+}
+
+// Write a packed date back out as "YYYY-MM-DD"
+static void formatDate(uint32_t date, char* out) {
+    snprintf(out, 11, "%04u-%02u-%02u", (unsigned)(date / 10000) % 10000,
+             (unsigned)(date / 100 % 100), (unsigned)(date % 100));
+}
+
+// Fill in a task with enhanced error checking; returns 0 on invalid input.
+// The task points into desc, trimmed, and at status rather than copying.
+int createTask(Task* task, int id, const char* desc, size_t descLength, int priority, const char* status, const char* date) {
     // Validate inputs
-    if (!validateInput(desc, MAX_TASK_DESC) || 
-        priority < 1 || priority > 5 || 
+    if (desc == NULL ||
+        priority < 1 || priority > 5 ||
         !validateInput(status, MAX_STATUS)) {
         fprintf(stderr, "Invalid task parameters\n");
-        return NULL;
+        return 0;
     }
 
-    Task* newTask = (Task*)malloc(sizeof(Task));
-    HANDLE_MEMORY_ERROR(newTask);
+    // Trim the description without copying it
+    while (descLength > 0 && isspace((unsigned char)*desc)) {
+        desc++;
+        descLength--;
+    }
+    while (descLength > 0 && isspace((unsigned char)desc[descLength - 1])) descLength--;
+    if (descLength == 0 || descLength > MAX_STORED_DESC) {
+        fprintf(stderr, "Invalid task parameters\n");
+        return 0;
+    }
 
-    // Safe string copying with trimming
-    char trimmedDesc[MAX_TASK_DESC];
-    strncpy(trimmedDesc, desc, MAX_TASK_DESC - 1);
-    trimmedDesc[MAX_TASK_DESC - 1] = '\0';
-    trimWhitespace(trimmedDesc);
+    task->id = id;
+    task->description = desc;
+    task->descLength = descLength;
+    task->priority = priority;
+    task->status = status;
+    task->date = packDate(date, strlen(date));
+    return 1;
+}
 
-    newTask->id = id;
-    strncpy(newTask->description, trimmedDesc, MAX_TASK_DESC - 1);
-    newTask->description[MAX_TASK_DESC - 1] = '\0';
-    
-    newTask->priority = (priority >= 1 && priority <= 5) ? priority : 5;
-    
-    strncpy(newTask->status, status, MAX_STATUS - 1);
-    newTask->status[MAX_STATUS - 1] = '\0';
-    
-    strncpy(newTask->date, date, 10);
-    newTask->date[10] = '\0';
-    
-    newTask->next = NULL;
-    return newTask;
+// The task in a slot, pointing at the store's own text
+Task taskAt(size_t slot) {
+    Task task;
+    task.id = store.ids[slot];
+    task.description = store.arena + store.descOffsets[slot];
+    task.descLength = strlen(task.description);
+    task.priority = store.priorities[slot];
+    task.status = store.statuses[store.statusCodes[slot]].name;
+    task.date = store.dates[slot];
+    return task;
+}
+
+// Fibonacci hashing of an id onto the index
+static size_t hashId(int id) {
+    return (size_t)(((uint64_t)(unsigned)id * 0x9E3779B97F4A7C15ULL) >> 32) & store.indexMask;
+}
+
+// Index entry holding id, or the empty entry where it would go
+static size_t probeIndex(int id) {
+    size_t i = hashId(id);
+    while (store.index[i] != EMPTY_SLOT && store.ids[store.index[i]] != id) {
+        i = (i + 1) & store.indexMask;
+    }
+    return i;
+}
+
+// Does slot a come before slot b in priority order?
+static int heapBefore(size_t a, size_t b) {
+    if (store.priorities[a] != store.priorities[b]) return store.priorities[a] < store.priorities[b];
+    return store.ids[a] < store.ids[b];
+}
+
+static void heapPlace(size_t pos, size_t slot) {
+    store.heap[pos] = (uint32_t)slot;
+    store.heapPos[slot] = (uint32_t)pos;
+}
+
+static void heapUp(size_t pos) {
+    size_t slot = store.heap[pos];
+    while (pos > 0 && heapBefore(slot, store.heap[(pos - 1) / 2])) {
+        heapPlace(pos, store.heap[(pos - 1) / 2]);
+        pos = (pos - 1) / 2;
+    }
+    heapPlace(pos, slot);
+}
+
+static void heapDown(size_t pos) {
+    size_t slot = store.heap[pos];
+    size_t child;
+    while ((child = 2 * pos + 1) < store.count) {
+        if (child + 1 < store.count && heapBefore(store.heap[child + 1], store.heap[child])) child++;
+        if (!heapBefore(store.heap[child], slot)) break;
+        heapPlace(pos, store.heap[child]);
+        pos = child;
+    }
+    heapPlace(pos, slot);
+}
+
+// Sift down in a plain array of slots with the heap's order
+static void siftSlots(uint32_t* heap, size_t count, size_t pos) {
+    size_t child;
+    while ((child = 2 * pos + 1) < count) {
+        if (child + 1 < count && heapBefore(heap[child + 1], heap[child])) child++;
+        if (!heapBefore(heap[child], heap[pos])) break;
+        uint32_t t = heap[pos];
+        heap[pos] = heap[child];
+        heap[child] = t;
+        pos = child;
+    }
+}
+
+// Resize a column to capacity entries of size bytes each
+static void* growColumn(void* column, size_t capacity, size_t size) {
+    column = realloc(column, capacity * size);
+    HANDLE_MEMORY_ERROR(column);
+    return column;
+}
+
+// Grow a slot bitmap, clearing the new words
+static uint64_t* growBits(uint64_t* bits, size_t oldWords, size_t words) {
+    bits = (uint64_t*)realloc(bits, words * sizeof(uint64_t));
+    HANDLE_MEMORY_ERROR(bits);
+    memset(bits + oldWords, 0, (words - oldWords) * sizeof(uint64_t));
+    return bits;
+}
+
+// Grow the columns, the heap and the query indexes to hold count tasks.
+// The capacity is a power of two of at least 64, a whole number of words.
+static void reserveTasks(size_t count) {
+    if (count <= store.capacity) return;
+    if (count >= EMPTY_SLOT) {
+        fprintf(stderr, "Too many tasks to store\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t capacity = store.capacity ? store.capacity : 64;
+    while (capacity < count) capacity *= 2;
+    store.ids = (int*)growColumn(store.ids, capacity, sizeof(int));
+    store.priorities = (uint8_t*)growColumn(store.priorities, capacity, sizeof(uint8_t));
+    store.statusCodes = (uint16_t*)growColumn(store.statusCodes, capacity, sizeof(uint16_t));
+    store.dates = (uint32_t*)growColumn(store.dates, capacity, sizeof(uint32_t));
+    store.descOffsets = (uint32_t*)growColumn(store.descOffsets, capacity, sizeof(uint32_t));
+    store.heap = (uint32_t*)growColumn(store.heap, capacity, sizeof(uint32_t));
+    store.heapPos = (uint32_t*)growColumn(store.heapPos, capacity, sizeof(uint32_t));
+    store.byDate = (uint32_t*)growColumn(store.byDate, capacity, sizeof(uint32_t));
+    for (int p = 0; p < 5; p++) {
+        store.priorityBits[p] = growBits(store.priorityBits[p], store.capacity / 64, capacity / 64);
+    }
+    for (size_t i = 0; i < store.statusCount; i++) {
+        store.statuses[i].bits = growBits(store.statuses[i].bits, store.capacity / 64, capacity / 64);
+    }
+    store.capacity = capacity;
+}
+
+// Make room for capacity bytes of descriptions
+static void reserveArena(size_t capacity) {
+    if (capacity <= store.arenaCapacity) return;
+    store.arena = (char*)growColumn(store.arena, capacity, 1);
+    store.arenaCapacity = capacity;
+}
+
+// Copy the descriptions in use into a new arena with room for extra more
+// bytes, leaving the garbage behind
+static void compactArena(size_t extra) {
+    size_t capacity = 2 * (store.arenaUsed - store.arenaGarbage + extra);
+    if (capacity < 1024) capacity = 1024;
+    char* arena = (char*)malloc(capacity);
+    HANDLE_MEMORY_ERROR(arena);
+    size_t used = 0;
+    for (size_t slot = 0; slot < store.count; slot++) {
+        const char* text = store.arena + store.descOffsets[slot];
+        size_t len = strlen(text) + 1;
+        memcpy(arena + used, text, len);
+        store.descOffsets[slot] = (uint32_t)used;
+        used += len;
+    }
+    free(store.arena);
+    store.arena = arena;
+    store.arenaUsed = used;
+    store.arenaCapacity = capacity;
+    store.arenaGarbage = 0;
+}
+
+// Append len bytes of text to the arena, NUL-terminated; returns the
+// offset. When the arena is full and at least half garbage it is copied
+// rather than grown, unless text is in the arena itself.
+static uint32_t storeDescription(const char* text, size_t len) {
+    size_t needed = store.arenaUsed + len + 1;
+    if (needed > store.arenaCapacity) {
+        int inArena = store.arena != NULL && text >= store.arena && text < store.arena + store.arenaUsed;
+        size_t from = inArena ? (size_t)(text - store.arena) : 0;
+        if (!inArena && store.arenaGarbage > 0 && 2 * store.arenaGarbage >= store.arenaUsed) {
+            compactArena(len + 1);
+        } else {
+            size_t capacity = store.arenaCapacity ? 2 * store.arenaCapacity : 1024;
+            while (capacity < needed) capacity *= 2;
+            reserveArena(capacity);
+        }
+        if (inArena) text = store.arena + from;
+    }
+    if (store.arenaUsed + len + 1 > UINT32_MAX) {
+        fprintf(stderr, "Too much description text to store\n");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t offset = (uint32_t)store.arenaUsed;
+    memmove(store.arena + offset, text, len);
+    store.arena[offset + len] = '\0';
+    store.arenaUsed += len + 1;
+    return offset;
+}
+
+// Copy a task's columns from one slot to another
+static void copySlot(size_t from, size_t to) {
+    store.ids[to] = store.ids[from];
+    store.priorities[to] = store.priorities[from];
+    store.statusCodes[to] = store.statusCodes[from];
+    store.dates[to] = store.dates[from];
+    store.descOffsets[to] = store.descOffsets[from];
+}
+
+// Rebuild the index over every slot, at least twice as large as count.
+// Where two slots share an id, the later one wins; returns how often.
+static size_t buildIndex(size_t count) {
+    size_t size = 128;
+    while (size < 2 * count) size *= 2;
+    free(store.index);
+    store.index = (uint32_t*)malloc(size * sizeof(uint32_t));
+    HANDLE_MEMORY_ERROR(store.index);
+    store.indexMask = size - 1;
+    for (size_t i = 0; i < size; i++) store.index[i] = EMPTY_SLOT;
+    size_t replaced = 0;
+    for (size_t slot = 0; slot < store.count; slot++) {
+        size_t entry = probeIndex(store.ids[slot]);
+        replaced += store.index[entry] != EMPTY_SLOT;
+        store.index[entry] = (uint32_t)slot;
+    }
+    return replaced;
+}
+
+static uint64_t dateKey(size_t slot) {
+    return (uint64_t)store.dates[slot] << 32 | ((uint32_t)store.ids[slot] ^ 0x80000000u);
+}
+
+// First of the first n date index entries whose key is not below key
+static size_t lowerBoundDate(uint64_t key, size_t n) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (dateKey(store.byDate[mid]) < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// A status's code, adding it to the table if it is new
+static uint16_t internStatus(const char* name) {
+    for (size_t i = 0; i < store.statusCount; i++) {
+        if (strcmp(store.statuses[i].name, name) == 0) return (uint16_t)i;
+    }
+    if (store.statusCount > UINT16_MAX) {
+        fprintf(stderr, "Too many different statuses\n");
+        exit(EXIT_FAILURE);
+    }
+    store.statuses = (StatusBits*)realloc(store.statuses, (store.statusCount + 1) * sizeof(StatusBits));
+    HANDLE_MEMORY_ERROR(store.statuses);
+    StatusBits* added = &store.statuses[store.statusCount];
+    strncpy(added->name, name, MAX_STATUS - 1);
+    added->name[MAX_STATUS - 1] = '\0';
+    added->bits = (uint64_t*)calloc(store.capacity ? store.capacity / 64 : 1, sizeof(uint64_t));
+    HANDLE_MEMORY_ERROR(added->bits);
+    return (uint16_t)store.statusCount++;
+}
+
+// Add a slot to the query indexes
+static void indexSlot(size_t slot) {
+    SET_BIT(store.priorityBits[store.priorities[slot] - 1], slot);
+    SET_BIT(store.statuses[store.statusCodes[slot]].bits, slot);
+    store.byDateStale = 1;
+}
+
+// Take a slot out of the query indexes
+static void unindexSlot(size_t slot) {
+    CLEAR_BIT(store.priorityBits[store.priorities[slot] - 1], slot);
+    CLEAR_BIT(store.statuses[store.statusCodes[slot]].bits, slot);
+    store.byDateStale = 1;
+}
+
+// Point the query indexes at a task's new slot
+static void moveSlotIndexes(size_t from, size_t to) {
+    uint64_t* bits = store.priorityBits[store.priorities[to] - 1];
+    CLEAR_BIT(bits, from);
+    SET_BIT(bits, to);
+    bits = store.statuses[store.statusCodes[to]].bits;
+    CLEAR_BIT(bits, from);
+    SET_BIT(bits, to);
+    store.byDateStale = 1;
+}
+
+#define DATE_ENTRY_LESS(a, b) ((a).key < (b).key)
+SORT_DEFINE(sortDateEntries, DateEntry, DATE_ENTRY_LESS)
+
+// Re-sort the date index if anything changed since it was last sorted. The
+// slots are sorted with their keys alongside, and only the slots are kept.
+static void refreshDateIndex() {
+    if (!store.byDateStale) return;
+    DateEntry* entries = (DateEntry*)malloc((store.count ? store.count : 1) * sizeof(DateEntry));
+    HANDLE_MEMORY_ERROR(entries);
+    for (size_t slot = 0; slot < store.count; slot++) {
+        entries[slot].key = dateKey(slot);
+        entries[slot].slot = (uint32_t)slot;
+    }
+    sortDateEntries(entries, store.count);
+    for (size_t i = 0; i < store.count; i++) store.byDate[i] = entries[i].slot;
+    free(entries);
+    store.byDateStale = 0;
+}
+
+// Rebuild the bitmaps over every slot; the date index waits for a query
+static void buildQueryIndexes() {
+    size_t words = store.capacity / 64;
+    store.byDateStale = 1;
+    if (words == 0) return;
+    for (int p = 0; p < 5; p++) memset(store.priorityBits[p], 0, words * sizeof(uint64_t));
+    for (size_t i = 0; i < store.statusCount; i++) memset(store.statuses[i].bits, 0, words * sizeof(uint64_t));
+    for (size_t slot = 0; slot < store.count; slot++) {
+        SET_BIT(store.priorityBits[store.priorities[slot] - 1], slot);
+        SET_BIT(store.statuses[store.statusCodes[slot]].bits, slot);
+    }
+}
+
+// Find a task's slot by id in O(1); EMPTY_SLOT if there is none
+size_t findSlot(int id) {
+    if (store.index == NULL) return EMPTY_SLOT;
+    return store.index[probeIndex(id)];
+}
+
+// Add a task, replacing any task with the same id
+void insertTask(const Task* task) {
+    if (findSlot(task->id) != EMPTY_SLOT) {
+        removeTask(task->id);
+    }
+    reserveTasks(store.count + 1);
+    if (store.index == NULL || 2 * (store.count + 1) > store.indexMask + 1) {
+        buildIndex(store.count + 1);
+    }
+    uint32_t offset = storeDescription(task->description, task->descLength);
+    uint16_t status = internStatus(task->status);
+    size_t slot = store.count++;
+    store.ids[slot] = task->id;
+    store.priorities[slot] = (uint8_t)task->priority;
+    store.statusCodes[slot] = status;
+    store.dates[slot] = task->date;
+    store.descOffsets[slot] = offset;
+    store.index[probeIndex(task->id)] = (uint32_t)slot;
+    heapPlace(slot, slot);
+    heapUp(slot);
+    indexSlot(slot);
+}
+
+// Change a task's status, moving it between the status bitmaps
+void setTaskStatus(size_t slot, const char* status) {
+    uint16_t code = internStatus(status);
+    CLEAR_BIT(store.statuses[store.statusCodes[slot]].bits, slot);
+    store.statusCodes[slot] = code;
+    SET_BIT(store.statuses[code].bits, slot);
+}
+
+// Remove a task by id in O(log n); returns 0 if there is none
+int removeTask(int id) {
+    if (store.count == 0) return 0;
+    size_t entry = probeIndex(id);
+    size_t slot = store.index[entry];
+    if (slot == EMPTY_SLOT) return 0;
+
+    // Backward-shift deletion: pull later entries of the probe run into the
+    // hole, so lookups never need tombstones
+    size_t hole = entry;
+    for (size_t i = (hole + 1) & store.indexMask; store.index[i] != EMPTY_SLOT; i = (i + 1) & store.indexMask) {
+        size_t home = hashId(store.ids[store.index[i]]);
+        if (((i - home) & store.indexMask) >= ((i - hole) & store.indexMask)) {
+            store.index[hole] = store.index[i];
+            hole = i;
+        }
+    }
+    store.index[hole] = EMPTY_SLOT;
+    unindexSlot(slot);
+    store.arenaGarbage += strlen(store.arena + store.descOffsets[slot]) + 1;
+
+    // Take the slot out of the heap, replacing it with the heap's last entry
+    size_t pos = store.heapPos[slot];
+    size_t moved = store.heap[store.count - 1];
+    store.count--;
+    if (pos != store.count) {
+        heapPlace(pos, moved);
+        heapDown(pos);
+        heapUp(store.heapPos[moved]);
+    }
+    store.count++;
+
+    // Move the last task into the freed slot
+    size_t last = store.count - 1;
+    if (slot != last) {
+        copySlot(last, slot);
+        store.index[probeIndex(store.ids[slot])] = (uint32_t)slot;
+        heapPlace(store.heapPos[last], slot);
+        moveSlotIndexes(last, slot);
+    }
+    if (--store.count == 0) {
+        store.arenaUsed = 0;
+        store.arenaGarbage = 0;
+    }
+    return 1;
+}
+
+// Build the hash index and heapify after a bulk load, in O(n), then the
+// query indexes. Where several tasks share an id, only the last one is kept.
+void rebuildIndexes() {
+    if (buildIndex(store.count) > 0) {
+        size_t kept = 0;
+        for (size_t slot = 0; slot < store.count; slot++) {
+            if (store.index[probeIndex(store.ids[slot])] == slot) {
+                store.heap[kept++] = (uint32_t)slot;
+            } else {
+                store.arenaGarbage += strlen(store.arena + store.descOffsets[slot]) + 1;
+            }
+        }
+        for (size_t i = 0; i < kept; i++) copySlot(store.heap[i], i);
+        store.count = kept;
+        buildIndex(store.count);
+    }
+    for (size_t slot = 0; slot < store.count; slot++) heapPlace(slot, slot);
+    for (size_t pos = store.count / 2; pos-- > 0;) heapDown(pos);
+    buildQueryIndexes();
+}
+
+static void printTaskHeader() {
+    printf("\n%-5s %-40s %-10s %-10s %-12s\n", "ID", "Description", "Priority", "Status", "Date");
+    printf("----------------------------------------------------------------\n");
+}
+
+static void printTaskRow(size_t slot) {
+    char date[11];
+    formatDate(store.dates[slot], date);
+    printf("%-5d %-40s %-10d %-10s %-12s\n",
+           store.ids[slot],
+           store.arena + store.descOffsets[slot],
+           store.priorities[slot],
+           store.statuses[store.statusCodes[slot]].name,
+           date);
 }
 
-// View all tasks
+// View all tasks, highest priority first
 void viewTasks() {
-    if (taskList == NULL) {
+    if (store.count == 0) {
         printf("\nNo tasks found!\n");
         return;
     }
     
-    printf("\n%-5s %-40s %-10s %-10s %-12s\n", "ID", "Description", "Priority", "Status", "Date");
-    printf("----------------------------------------------------------------\n");
+    printTaskHeader();
     
-    Task* current = taskList;
-    while (current != NULL) {
-        printf("%-5d %-40s %-10d %-10s %-12s\n",
-               current->id,
-               current->description,
-               current->priority,
-               current->status,
-               current->date);
-        current = current->next;
+    // Pop the tasks off a copy of the heap, so the index is left alone
+    size_t count = store.count;
+    uint32_t* order = (uint32_t*)malloc(count * sizeof(uint32_t));
+    HANDLE_MEMORY_ERROR(order);
+    memcpy(order, store.heap, count * sizeof(uint32_t));
+    while (count > 0) {
+        printTaskRow(order[0]);
+        order[0] = order[--count];
+        siftSlots(order, count, 0);
     }
+    free(order);
 }
 
 // Add a new task with improved input handling
@@ -176,28 +773,15 @@ void addTask() {
     // Validate and clamp priority
     priority = (priority < 1) ? 5 : (priority > 5) ? 5 : priority;
     
-    Task* newTask = createTask(nextId++, desc, priority, "Pending", getCurrentDate());
-    
-    if (newTask == NULL) {
+    Task newTask;
+    if (!createTask(&newTask, nextId++, desc, strlen(desc), priority, "Pending", getCurrentDate())) {
         printf("Failed to create task.\n");
         return;
     }
     
-    // Add to list in sorted order (by priority)
-    if (taskList == NULL || taskList->priority > priority) {
-        newTask->next = taskList;
-        taskList = newTask;
-    } else {
-        Task* current = taskList;
-        while (current->next != NULL && current->next->priority <= priority) {
-            current = current->next;
-        }
-        newTask->next = current->next;
-        current->next = newTask;
-    }
-    
+    insertTask(&newTask);
     printf("Task added successfully!\n");
-    saveToFile(); // Automatically save after adding
+    journalPut(&newTask); // Automatically save after adding
 }
 
 // Update task status
@@ -206,19 +790,22 @@ void updateTaskStatus() {
     printf("\nEnter task ID to update: ");
     scanf("%d", &id);
     
-    Task* current = taskList;
-    while (current != NULL) {
-        if (current->id == id) {
-            printf("Current status: %s\n", current->status);
-            printf("Enter new status (Pending/In Progress/Completed): ");
-            scanf("%s", current->status);
-            printf("Status updated successfully!\n");
-            saveToFile(); // Automatically save after updating
-            return;
-        }
-        current = current->next;
+    size_t slot = findSlot(id);
+    if (slot == EMPTY_SLOT) {
+        printf("Task not found!\n");
+        return;
+    }
+    printf("Current status: %s\n", store.statuses[store.statusCodes[slot]].name);
+    printf("Enter new status (Pending/In Progress/Completed): ");
+    char status[MAX_STATUS];
+    if (scanf("%19s", status) != 1) {
+        printf("Invalid status.\n");
+        return;
     }
-    printf("Task not found!\n");
+    setTaskStatus(slot, status);
+    printf("Status updated successfully!\n");
+    Task updated = taskAt(slot);
+    journalPut(&updated); // Automatically save after updating
 }
 
 // Delete a task
@@ -227,110 +814,966 @@ void deleteTask() {
     printf("\nEnter task ID to delete: ");
     scanf("%d", &id);
     
-    if (taskList == NULL) {
+    if (store.count == 0) {
         printf("No tasks to delete!\n");
         return;
     }
     
-    if (taskList->id == id) {
-        Task* temp = taskList;
-        taskList = taskList->next;
-        free(temp);
-        printf("Task deleted successfully!\n");
-        saveToFile(); // Automatically save after deleting
+    if (!removeTask(id)) {
+        printf("Task not found!\n");
         return;
     }
-    
-    Task* current = taskList;
-    while (current->next != NULL) {
-        if (current->next->id == id) {
-            Task* temp = current->next;
-            current->next = current->next->next;
-            free(temp);
-            printf("Task deleted successfully!\n");
-            saveToFile(); // Automatically save after deleting
-            return;
+    printf("Task deleted successfully!\n");
+    journalDelete(id); // Automatically save after deleting
+}
+
+// Queries: conditions, all of which must hold, then optional ordering and
+// limit, e.g. status=Pending priority<=2 date>=2024-11-01 order by date limit 50
+//   id       = < <= > >=         status  = !=  (case-insensitive, "quoted")
+//   priority = != < <= > >=      date    = < <= > >=  (YYYY-MM-DD)
+//   order by id|priority|status|date [asc|desc]    limit N
+// Status and priority conditions combine their bitmaps word by word, and
+// date conditions pick a range of the date index, so a query touches one
+// bit per task at most and never the tasks it rules out.
+enum { FIELD_ID, FIELD_PRIORITY, FIELD_STATUS, FIELD_DATE };
+enum { OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE };
+
+#define QUERY_MAX_LINE 256
+
+typedef struct Query {
+    long long idLo, idHi;    // inclusive bounds
+    uint32_t dateLo, dateHi; // inclusive bounds, packed YYYYMMDD
+    int priorityAllowed[5];
+    int order;
+    int descending;
+    size_t limit;
+} Query;
+
+// Ordering for sortResults, set before each sort. Statuses are compared by
+// their rank in name order, so every comparison is between integers.
+static int queryOrder = FIELD_PRIORITY;
+static int queryDescending = 0;
+static uint16_t* statusRanks = NULL;
+
+#define COMPARE(x, y) (((x) > (y)) - ((x) < (y)))
+
+static int resultBefore(size_t a, size_t b) {
+    int c;
+    switch (queryOrder) {
+        case FIELD_STATUS: c = COMPARE(statusRanks[store.statusCodes[a]], statusRanks[store.statusCodes[b]]); break;
+        case FIELD_DATE: c = COMPARE(store.dates[a], store.dates[b]); break;
+        case FIELD_PRIORITY: c = COMPARE(store.priorities[a], store.priorities[b]); break;
+        default: c = 0;
+    }
+    if (c == 0) c = COMPARE(store.ids[a], store.ids[b]);
+    return queryDescending ? c > 0 : c < 0;
+}
+
+// Rank every status by name into statusRanks
+static void rankStatuses() {
+    free(statusRanks);
+    statusRanks = (uint16_t*)malloc((store.statusCount ? store.statusCount : 1) * sizeof(uint16_t));
+    HANDLE_MEMORY_ERROR(statusRanks);
+    for (size_t i = 0; i < store.statusCount; i++) {
+        size_t rank = 0;
+        for (size_t j = 0; j < store.statusCount; j++) {
+            rank += strcmp(store.statuses[j].name, store.statuses[i].name) < 0;
+        }
+        statusRanks[i] = (uint16_t)rank;
+    }
+}
+
+#define RESULT_LESS(a, b) resultBefore(a, b)
+SORT_DEFINE(sortResults, size_t, RESULT_LESS)
+
+// Index of the lowest set bit of a non-zero word
+static int lowestBit(uint64_t w) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(w);
+#else
+    int n = 0;
+    while (!(w & 1)) {
+        w >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static int equalsIgnoreCase(const char* a, const char* b) {
+    while (*a && tolower((unsigned char)*a) == tolower((unsigned char)*b)) {
+        a++;
+        b++;
+    }
+    return *a == '\0' && *b == '\0';
+}
+
+// Read a word of letters, lower-cased, into out; returns the text after it
+static const char* readWord(const char* p, char* out, size_t cap) {
+    size_t n = 0;
+    while (isspace((unsigned char)*p)) p++;
+    while (isalpha((unsigned char)*p)) {
+        if (n + 1 < cap) out[n++] = (char)tolower((unsigned char)*p);
+        p++;
+    }
+    out[n] = '\0';
+    return p;
+}
+
+static int fieldNamed(const char* name) {
+    if (strcmp(name, "id") == 0) return FIELD_ID;
+    if (strcmp(name, "priority") == 0) return FIELD_PRIORITY;
+    if (strcmp(name, "status") == 0) return FIELD_STATUS;
+    if (strcmp(name, "date") == 0) return FIELD_DATE;
+    return -1;
+}
+
+// Tighten an inclusive range [lo, hi] by "op value"
+static int narrowRange(long long* lo, long long* hi, int op, long long value) {
+    switch (op) {
+        case OP_EQ: if (value > *lo) *lo = value; if (value < *hi) *hi = value; return 1;
+        case OP_LT: if (value - 1 < *hi) *hi = value - 1; return 1;
+        case OP_LE: if (value < *hi) *hi = value; return 1;
+        case OP_GT: if (value + 1 > *lo) *lo = value + 1; return 1;
+        case OP_GE: if (value > *lo) *lo = value; return 1;
+        default: return 0;
+    }
+}
+
+// Parse a query into q, applying status conditions to the bitmap match
+// (words long) as they come; returns 0 after printing why on a bad query
+static int parseQuery(const char* p, Query* q, uint64_t* match, size_t words) {
+    char word[16];
+    while (*(p = readWord(p, word, sizeof(word))) != '\0' || word[0] != '\0') {
+        if (strcmp(word, "order") == 0) {
+            p = readWord(p, word, sizeof(word));
+            if (strcmp(word, "by") != 0) {
+                printf("Expected 'order by'.\n");
+                return 0;
+            }
+            p = readWord(p, word, sizeof(word));
+            if ((q->order = fieldNamed(word)) < 0) {
+                printf("Cannot order by '%s'.\n", word);
+                return 0;
+            }
+            const char* after = readWord(p, word, sizeof(word));
+            if (strcmp(word, "asc") == 0 || strcmp(word, "desc") == 0) {
+                q->descending = word[0] == 'd';
+                p = after;
+            }
+            continue;
+        }
+        if (strcmp(word, "limit") == 0) {
+            char* end;
+            long long n = strtoll(p, &end, 10);
+            if (end == p || n < 0) {
+                printf("Expected a number after 'limit'.\n");
+                return 0;
+            }
+            q->limit = (size_t)n;
+            p = end;
+            continue;
+        }
+
+        int field = fieldNamed(word);
+        if (field < 0) {
+            printf("Unknown field '%s'.\n", word);
+            return 0;
+        }
+        while (isspace((unsigned char)*p)) p++;
+        int op;
+        if (p[0] == '!' && p[1] == '=') { op = OP_NE; p += 2; }
+        else if (p[0] == '<' && p[1] == '=') { op = OP_LE; p += 2; }
+        else if (p[0] == '>' && p[1] == '=') { op = OP_GE; p += 2; }
+        else if (p[0] == '=' && p[1] == '=') { op = OP_EQ; p += 2; }
+        else if (*p == '<') { op = OP_LT; p++; }
+        else if (*p == '>') { op = OP_GT; p++; }
+        else if (*p == '=') { op = OP_EQ; p++; }
+        else {
+            printf("Expected a comparison after '%s'.\n", word);
+            return 0;
+        }
+        while (isspace((unsigned char)*p)) p++;
+        char value[QUERY_MAX_LINE];
+        size_t n = 0;
+        if (*p == '"') {
+            for (p++; *p && *p != '"'; p++) value[n++] = *p;
+            if (*p == '"') p++;
+        } else {
+            while (*p && !isspace((unsigned char)*p)) value[n++] = *p++;
+        }
+        value[n] = '\0';
+
+        if (field == FIELD_STATUS) {
+            if (op != OP_EQ && op != OP_NE) {
+                printf("Status can only be compared with = or !=.\n");
+                return 0;
+            }
+            // OR together every status spelled this way, then AND it in
+            uint64_t* any = (uint64_t*)calloc(words ? words : 1, sizeof(uint64_t));
+            HANDLE_MEMORY_ERROR(any);
+            for (size_t i = 0; i < store.statusCount; i++) {
+                if (!equalsIgnoreCase(store.statuses[i].name, value)) continue;
+                for (size_t w = 0; w < words; w++) any[w] |= store.statuses[i].bits[w];
+            }
+            for (size_t w = 0; w < words; w++) match[w] &= op == OP_EQ ? any[w] : ~any[w];
+            free(any);
+        } else if (field == FIELD_DATE) {
+            uint32_t date = packDate(value, n);
+            long long lo = q->dateLo, hi = q->dateHi;
+            if (date == 0 || !narrowRange(&lo, &hi, op, date)) {
+                printf(date == 0 ? "Dates are written YYYY-MM-DD.\n" : "Dates cannot be compared with !=.\n");
+                return 0;
+            }
+            q->dateLo = lo < 0 ? 0 : (uint32_t)lo;
+            q->dateHi = hi < 0 ? 0 : (uint32_t)hi;
+            if (lo > hi) q->dateLo = 1, q->dateHi = 0;
+        } else {
+            char* end;
+            long long v = strtoll(value, &end, 10);
+            if (end == value || *end != '\0') {
+                printf("Expected a number after %s.\n", word);
+                return 0;
+            }
+            if (field == FIELD_PRIORITY) {
+                for (int pr = 1; pr <= 5; pr++) {
+                    int keep = op == OP_EQ ? pr == v : op == OP_NE ? pr != v : op == OP_LT ? pr < v :
+                               op == OP_LE ? pr <= v : op == OP_GT ? pr > v : pr >= v;
+                    if (!keep) q->priorityAllowed[pr - 1] = 0;
+                }
+            } else if (!narrowRange(&q->idLo, &q->idHi, op, v)) {
+                printf("Ids cannot be compared with !=.\n");
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Run a query and print the matching tasks
+static void runQuery(const char* text) {
+    size_t words = (store.count + 63) / 64;
+    uint64_t* match = (uint64_t*)malloc((words ? words : 1) * sizeof(uint64_t));
+    HANDLE_MEMORY_ERROR(match);
+    for (size_t w = 0; w < words; w++) match[w] = ~0ULL;
+    if (store.count % 64) match[words - 1] = (1ULL << (store.count % 64)) - 1;
+
+    Query q = {INT32_MIN, INT32_MAX, 0, UINT32_MAX, {1, 1, 1, 1, 1}, FIELD_PRIORITY, 0, SIZE_MAX};
+    if (!parseQuery(text, &q, match, words)) {
+        free(match);
+        return;
+    }
+    for (int pr = 1; pr <= 5; pr++) {
+        if (q.priorityAllowed[pr - 1]) continue;
+        for (size_t w = 0; w < words; w++) match[w] &= ~store.priorityBits[pr - 1][w];
+    }
+
+    size_t* results = NULL;
+    size_t found = 0;
+    int complete = 1;
+    if (q.idLo == q.idHi) {
+        // A single id goes straight to the hash index
+        results = (size_t*)malloc(sizeof(size_t));
+        HANDLE_MEMORY_ERROR(results);
+        size_t slot = findSlot((int)q.idLo);
+        if (slot != EMPTY_SLOT) {
+            uint32_t date = store.dates[slot];
+            if (TEST_BIT(match, slot) && date >= q.dateLo && date <= q.dateHi) results[found++] = slot;
         }
-        current = current->next;
+    } else if (q.dateLo > 0 || q.dateHi < UINT32_MAX || q.order == FIELD_DATE) {
+        // Walk the date range, in date order, stopping at the limit if the
+        // output is ordered by date
+        refreshDateIndex();
+        size_t lo = lowerBoundDate((uint64_t)q.dateLo << 32, store.count);
+        size_t hi = q.dateHi == UINT32_MAX ? store.count : lowerBoundDate((uint64_t)(q.dateHi + 1) << 32, store.count);
+        if (hi < lo) hi = lo;
+        results = (size_t*)malloc((hi > lo ? hi - lo : 1) * sizeof(size_t));
+        HANDLE_MEMORY_ERROR(results);
+        for (size_t i = 0; i < hi - lo; i++) {
+            if (q.order == FIELD_DATE && found == q.limit) {
+                complete = 0;
+                break;
+            }
+            size_t slot = store.byDate[q.descending && q.order == FIELD_DATE ? hi - 1 - i : lo + i];
+            int id = store.ids[slot];
+            if (TEST_BIT(match, slot) && id >= q.idLo && id <= q.idHi) results[found++] = slot;
+        }
+    } else {
+        // Walk the set bits of the combined bitmap
+        results = (size_t*)malloc((store.count ? store.count : 1) * sizeof(size_t));
+        HANDLE_MEMORY_ERROR(results);
+        for (size_t w = 0; w < words; w++) {
+            for (uint64_t bits = match[w]; bits != 0; bits &= bits - 1) {
+                size_t slot = w * 64 + (size_t)lowestBit(bits);
+                int id = store.ids[slot];
+                if (id >= q.idLo && id <= q.idHi) results[found++] = slot;
+            }
+        }
+    }
+
+    size_t shown = found;
+    if (q.order != FIELD_DATE || q.idLo == q.idHi) {
+        queryOrder = q.order;
+        queryDescending = q.descending;
+        if (q.order == FIELD_STATUS) rankStatuses();
+        if (q.limit < found) {
+            sortResults_select(results, found, q.limit);
+            shown = q.limit;
+        }
+        sortResults(results, shown);
+    }
+
+    if (shown > 0) {
+        printTaskHeader();
+        for (size_t i = 0; i < shown; i++) printTaskRow(results[i]);
+    }
+    if (complete) {
+        printf("%zu of %zu tasks matched.\n", found, store.count);
+    } else {
+        printf("First %zu matching tasks.\n", shown);
     }
-    printf("Task not found!\n");
+    free(results);
+    free(match);
 }
 
-// Save tasks to file
-void saveToFile() {
-    FILE* file = fopen("tasks.txt", "w");
+// Read a query from the user and run it
+void queryTasks() {
+    char line[QUERY_MAX_LINE];
+    printf("\nConditions, then optional 'order by' and 'limit', e.g.\n");
+    printf("  status=Pending priority<=2 date>=2024-11-01 order by date limit 50\n");
+    printf("Query: ");
+    getchar(); // Clear input buffer
+    if (fgets(line, sizeof(line), stdin) == NULL) {
+        printf("Input error.\n");
+        return;
+    }
+    line[strcspn(line, "\n")] = 0;
+    runQuery(line);
+}
+
+// Write a store's tasks to a file and flush it to disk; returns its size,
+// or -1. Only the columns, the arena and the status names are read.
+long saveToFile(const char* path, const TaskStore* tasks) {
+    FILE* file = fopen(path, "w");
     if (file == NULL) {
         printf("Error opening file for writing!\n");
-        return;
+        return -1;
     }
     
-    Task* current = taskList;
-    while (current != NULL) {
+    char date[11];
+    for (size_t slot = 0; slot < tasks->count; slot++) {
+        formatDate(tasks->dates[slot], date);
         fprintf(file, "%d|%s|%d|%s|%s\n",
-                current->id,
-                current->description,
-                current->priority,
-                current->status,
-                current->date);
-        current = current->next;
+                tasks->ids[slot],
+                tasks->arena + tasks->descOffsets[slot],
+                tasks->priorities[slot],
+                tasks->statuses[tasks->statusCodes[slot]].name,
+                date);
     }
     
+    long bytes = ftell(file);
+    int ok = syncFile(file);
+    return fclose(file) == 0 && ok ? bytes : -1;
+}
+
+// Journal records are [payload length][CRC-32 of payload][payload], with
+// little-endian 32-bit header fields. The payload is an opcode and an id,
+// and for JOURNAL_PUT the whole task: priority, then the lengths of
+// description, status and date, then their bytes. JOURNAL_PUT_LONG is the
+// same with a 16-bit description length, for descriptions past 255 bytes.
+// A PUT replaces the task and a DELETE removes it, so replaying a record
+// twice does no harm.
+enum { JOURNAL_PUT = 1, JOURNAL_DELETE = 2, JOURNAL_PUT_LONG = 3 };
+#define JOURNAL_MAX_PAYLOAD (10 + MAX_STORED_DESC + MAX_STATUS + 10)
+
+FILE* journal = NULL;
+long journalBytes = 0;
+long snapshotBytes = 0;
+int unsyncedRecords = 0;
+time_t lastSync = 0;
+int compactionRunning = 0;
+ThreadHandle compactionThread;
+TaskStore compactionTasks = {0};
+long compactionBytes = -1;
+
+static uint32_t crcTable[256];
+
+// CRC-32 (IEEE 802.3, reflected), table built on first use
+static uint32_t crc32(const unsigned char* data, size_t len) {
+    if (crcTable[1] == 0) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crcTable[n] = c;
+        }
+    }
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static void putU32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static uint32_t getU32(const unsigned char* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void* copyOf(const void* data, size_t size) {
+    void* copy = malloc(size ? size : 1);
+    HANDLE_MEMORY_ERROR(copy);
+    if (size > 0) memcpy(copy, data, size);
+    return copy;
+}
+
+// Copy what saveToFile reads from the store: the columns, the arena and
+// the status names
+static void copyColumns(TaskStore* copy) {
+    memset(copy, 0, sizeof(*copy));
+    copy->count = store.count;
+    copy->ids = (int*)copyOf(store.ids, store.count * sizeof(int));
+    copy->priorities = (uint8_t*)copyOf(store.priorities, store.count * sizeof(uint8_t));
+    copy->statusCodes = (uint16_t*)copyOf(store.statusCodes, store.count * sizeof(uint16_t));
+    copy->dates = (uint32_t*)copyOf(store.dates, store.count * sizeof(uint32_t));
+    copy->descOffsets = (uint32_t*)copyOf(store.descOffsets, store.count * sizeof(uint32_t));
+    copy->arena = (char*)copyOf(store.arena, store.arenaUsed);
+    copy->arenaUsed = store.arenaUsed;
+    copy->statuses = (StatusBits*)copyOf(store.statuses, store.statusCount * sizeof(StatusBits));
+    copy->statusCount = store.statusCount;
+    for (size_t i = 0; i < copy->statusCount; i++) copy->statuses[i].bits = NULL;
+}
+
+// Snapshot writer run on the compaction thread: write the copied tasks,
+// swap the snapshot in, and only then drop the journal it replaces
+static THREAD_FUNC(compactInBackground, unused) {
+    (void)unused;
+    compactionBytes = saveToFile(SNAPSHOT_TMP_FILE, &compactionTasks);
+    if (compactionBytes >= 0 && replaceFile(SNAPSHOT_TMP_FILE, TASKS_FILE)) {
+        remove(JOURNAL_OLD_FILE);
+    }
+    freeStore(&compactionTasks);
+    return 0;
+}
+
+static void waitForCompaction() {
+    if (!compactionRunning) return;
+    joinThread(compactionThread);
+    compactionRunning = 0;
+    if (compactionBytes >= 0) snapshotBytes = compactionBytes;
+}
+
+static void openJournal() {
+    journal = fopen(JOURNAL_FILE, "ab");
+    if (journal == NULL) {
+        printf("Error opening journal for writing!\n");
+        return;
+    }
+    fseek(journal, 0, SEEK_END);
+    journalBytes = ftell(journal);
+    lastSync = time(NULL);
+}
+
+// Move the journal aside and snapshot a copy of the tasks in the background.
+// If the background write fails, the old journal stays and is replayed.
+static void compactJournal() {
+    waitForCompaction();
+    if (journalBytes <= snapshotBytes) return;
+    if (journal != NULL) {
+        syncFile(journal);
+        fclose(journal);
+        journal = NULL;
+    }
+    // A journal left over from a failed compaction would be overwritten, so
+    // snapshot synchronously instead
+    FILE* leftover = fopen(JOURNAL_OLD_FILE, "rb");
+    if (leftover != NULL) {
+        fclose(leftover);
+        long bytes = saveToFile(SNAPSHOT_TMP_FILE, &store);
+        if (bytes >= 0 && replaceFile(SNAPSHOT_TMP_FILE, TASKS_FILE)) {
+            remove(JOURNAL_OLD_FILE);
+            remove(JOURNAL_FILE);
+            snapshotBytes = bytes;
+        }
+        openJournal();
+        return;
+    }
+    if (!replaceFile(JOURNAL_FILE, JOURNAL_OLD_FILE)) {
+        openJournal();
+        return;
+    }
+    openJournal();
+
+    copyColumns(&compactionTasks);
+    compactionRunning = startThread(&compactionThread, compactInBackground, NULL);
+    if (!compactionRunning) {
+        compactInBackground(NULL);
+    }
+}
+
+// Append one record. It is handed to the OS at once, so a crash of this
+// process loses nothing; fsync is batched, so a power cut can lose at most
+// the last JOURNAL_SYNC_RECORDS changes.
+static void journalAppend(const unsigned char* payload, size_t len) {
+    if (journal == NULL) {
+        openJournal();
+        if (journal == NULL) return;
+    }
+    unsigned char header[8];
+    putU32(header, (uint32_t)len);
+    putU32(header + 4, crc32(payload, len));
+    if (fwrite(header, 1, sizeof(header), journal) != sizeof(header) ||
+        fwrite(payload, 1, len, journal) != len || fflush(journal) != 0) {
+        printf("Error writing journal!\n");
+        return;
+    }
+    journalBytes += (long)(sizeof(header) + len);
+    if (++unsyncedRecords >= JOURNAL_SYNC_RECORDS || time(NULL) - lastSync >= JOURNAL_SYNC_SECONDS) {
+        syncFile(journal);
+        unsyncedRecords = 0;
+        lastSync = time(NULL);
+    }
+    if (journalBytes > JOURNAL_COMPACT_BYTES && journalBytes > snapshotBytes) {
+        compactJournal();
+    }
+}
+
+// Record an added or changed task
+void journalPut(const Task* task) {
+    unsigned char payload[JOURNAL_MAX_PAYLOAD];
+    char date[11];
+    formatDate(task->date, date);
+    size_t descLen = task->descLength;
+    size_t statusLen = strlen(task->status);
+    size_t dateLen = strlen(date);
+    size_t len = 6;
+    payload[0] = descLen > 255 ? JOURNAL_PUT_LONG : JOURNAL_PUT;
+    putU32(payload + 1, (uint32_t)task->id);
+    payload[5] = (unsigned char)task->priority;
+    payload[len++] = (unsigned char)descLen;
+    if (descLen > 255) payload[len++] = (unsigned char)(descLen >> 8);
+    payload[len++] = (unsigned char)statusLen;
+    payload[len++] = (unsigned char)dateLen;
+    memcpy(payload + len, task->description, descLen);
+    len += descLen;
+    memcpy(payload + len, task->status, statusLen);
+    len += statusLen;
+    memcpy(payload + len, date, dateLen);
+    len += dateLen;
+    journalAppend(payload, len);
+}
+
+// Record a deleted task
+void journalDelete(int id) {
+    unsigned char payload[5];
+    payload[0] = JOURNAL_DELETE;
+    putU32(payload + 1, (uint32_t)id);
+    journalAppend(payload, sizeof(payload));
+}
+
+// Apply one record; returns 0 if it is malformed
+static int applyRecord(const unsigned char* payload, size_t len, int* maxId) {
+    if (len < 5) return 0;
+    int id = (int)getU32(payload + 1);
+    if (payload[0] == JOURNAL_DELETE) {
+        if (len != 5) return 0;
+        removeTask(id);
+        return 1;
+    }
+    size_t head = payload[0] == JOURNAL_PUT_LONG ? 10 : 9;
+    if ((payload[0] != JOURNAL_PUT && payload[0] != JOURNAL_PUT_LONG) || len < head) return 0;
+    size_t descLen = head == 10 ? (size_t)payload[6] | (size_t)payload[7] << 8 : payload[6];
+    size_t statusLen = payload[head - 2], dateLen = payload[head - 1];
+    if (len != head + descLen + statusLen + dateLen || statusLen >= MAX_STATUS || dateLen > 10) {
+        return 0;
+    }
+    char status[MAX_STATUS], date[11];
+    memcpy(status, payload + head + descLen, statusLen);
+    status[statusLen] = '\0';
+    memcpy(date, payload + head + descLen + statusLen, dateLen);
+    date[dateLen] = '\0';
+    Task task;
+    if (!createTask(&task, id, (const char*)payload + head, descLen, payload[5], status, date)) return 0;
+    insertTask(&task);
+    if (id > *maxId) *maxId = id;
+    return 1;
+}
+
+// Replay a journal over the loaded tasks. Returns 0 if it ends in a torn or
+// corrupt record, whose changes and any after it are dropped.
+static int replayJournal(const char* path, int* maxId) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return 1;
+    unsigned char header[8], payload[JOURNAL_MAX_PAYLOAD];
+    size_t got;
+    int clean = 1;
+    while ((got = fread(header, 1, sizeof(header), file)) > 0) {
+        uint32_t len = getU32(header);
+        if (got != sizeof(header) || len > sizeof(payload) || fread(payload, 1, len, file) != len ||
+            crc32(payload, len) != getU32(header + 4) || !applyRecord(payload, len, maxId)) {
+            clean = 0;
+            break;
+        }
+    }
     fclose(file);
+    return clean;
+}
+
+// A read-only view of a whole file
+typedef struct MappedFile {
+    const char* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+} MappedFile;
+
+// Map a file into memory; returns 0 if it cannot be opened or mapped
+static int mapFile(const char* path, MappedFile* m) {
+    memset(m, 0, sizeof(*m));
+#ifdef _WIN32
+    m->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                          FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (m->file == INVALID_HANDLE_VALUE) return 0;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m->file, &size)) {
+        CloseHandle(m->file);
+        return 0;
+    }
+    m->size = (size_t)size.QuadPart;
+    if (m->size == 0) return 1;
+    m->mapping = CreateFileMappingA(m->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    m->data = m->mapping ? (const char*)MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (m->data == NULL) {
+        if (m->mapping) CloseHandle(m->mapping);
+        CloseHandle(m->file);
+        return 0;
+    }
+#else
+    m->fd = open(path, O_RDONLY);
+    if (m->fd < 0) return 0;
+    struct stat st;
+    if (fstat(m->fd, &st) != 0) {
+        close(m->fd);
+        return 0;
+    }
+    m->size = (size_t)st.st_size;
+    if (m->size == 0) return 1;
+    void* data = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, m->fd, 0);
+    if (data == MAP_FAILED) {
+        close(m->fd);
+        return 0;
+    }
+    m->data = (const char*)data;
+#endif
+    return 1;
+}
+
+static void unmapFile(MappedFile* m) {
+#ifdef _WIN32
+    if (m->data) UnmapViewOfFile(m->data);
+    if (m->mapping) CloseHandle(m->mapping);
+    CloseHandle(m->file);
+#else
+    if (m->data) munmap((void*)m->data, m->size);
+    close(m->fd);
+#endif
+}
+
+// Parse a decimal int with optional leading blanks and sign; returns the
+// character after it, or NULL if there is none or it overflows
+static const char* scanInt(const char* p, const char* end, int* out) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    int negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) p++;
+    if (p == end || !isdigit((unsigned char)*p)) return NULL;
+    long long v = 0;
+    while (p < end && isdigit((unsigned char)*p)) {
+        v = v * 10 + (*p++ - '0');
+        if (v > INT32_MAX) return NULL;
+    }
+    *out = (int)(negative ? -v : v);
+    return p;
+}
+
+// One thread's share of the snapshot: whole lines in [begin, end), parsed
+// into the slots from first on. Descriptions go into the arena from
+// arenaFirst on, the chunk's own offset in the file, which its lines
+// always have room for. Statuses get codes into the chunk's own table,
+// since the store's cannot be shared, and are interned at the end.
+typedef struct LoadChunk {
+    const char* begin;
+    const char* end;
+    size_t lines;
+    size_t first;
+    size_t parsed;
+    size_t arenaFirst;
+    size_t descBytes;
+    size_t truncated;
+    int maxId;
+    char (*statusNames)[MAX_STATUS];
+    size_t statusCount;
+} LoadChunk;
+
+// The chunk's code for the status in [begin, end), cut short if needed
+static uint16_t chunkStatus(LoadChunk* chunk, const char* begin, const char* end) {
+    size_t len = (size_t)(end - begin);
+    if (len >= MAX_STATUS) {
+        len = MAX_STATUS - 1;
+        chunk->truncated++;
+    }
+    for (size_t i = chunk->statusCount; i-- > 0;) {
+        const char* name = chunk->statusNames[i];
+        if (memcmp(name, begin, len) == 0 && name[len] == '\0') return (uint16_t)i;
+    }
+    if (chunk->statusCount > UINT16_MAX) {
+        fprintf(stderr, "Too many different statuses\n");
+        exit(EXIT_FAILURE);
+    }
+    chunk->statusNames = (char(*)[MAX_STATUS])realloc(chunk->statusNames, (chunk->statusCount + 1) * MAX_STATUS);
+    HANDLE_MEMORY_ERROR(chunk->statusNames);
+    memcpy(chunk->statusNames[chunk->statusCount], begin, len);
+    chunk->statusNames[chunk->statusCount][len] = '\0';
+    return (uint16_t)chunk->statusCount++;
 }
 
-// Load tasks from file
+// Parse one "id|description|priority|status|date" line in [p, end) into
+// the chunk's next slot, with the checks createTask makes; returns 0 for a
+// line to skip. Fields too long to store are cut short and counted.
+static int parseTaskLine(const char* p, const char* end, LoadChunk* chunk) {
+    const char* bar;
+    int id, priority;
+    if ((p = scanInt(p, end, &id)) == NULL || p == end || *p++ != '|') return 0;
+
+    if ((bar = (const char*)memchr(p, '|', (size_t)(end - p))) == NULL) return 0;
+    const char* desc = p;
+    const char* descEnd = bar;
+    while (desc < descEnd && isspace((unsigned char)*desc)) desc++;
+    while (descEnd > desc && isspace((unsigned char)descEnd[-1])) descEnd--;
+    if (desc == descEnd) return 0;
+    p = bar + 1;
+
+    if ((p = scanInt(p, end, &priority)) == NULL || p == end || *p++ != '|') return 0;
+    if (priority < 1 || priority > 5) return 0;
+
+    if ((bar = (const char*)memchr(p, '|', (size_t)(end - p))) == NULL || bar == p) return 0;
+    const char* status = p;
+    p = bar + 1;
+
+    while (p < end && isspace((unsigned char)*p)) p++;
+    const char* dateEnd = p;
+    while (dateEnd < end && !isspace((unsigned char)*dateEnd)) dateEnd++;
+    if (dateEnd == p) return 0;
+
+    size_t slot = chunk->first + chunk->parsed;
+    size_t descLen = (size_t)(descEnd - desc);
+    if (descLen > MAX_STORED_DESC) {
+        descLen = MAX_STORED_DESC;
+        chunk->truncated++;
+    }
+    char* text = store.arena + chunk->arenaFirst + chunk->descBytes;
+    memcpy(text, desc, descLen);
+    text[descLen] = '\0';
+    store.descOffsets[slot] = (uint32_t)chunk->descBytes;
+    chunk->descBytes += descLen + 1;
+    store.ids[slot] = id;
+    store.priorities[slot] = (uint8_t)priority;
+    store.statusCodes[slot] = chunkStatus(chunk, status, bar);
+    store.dates[slot] = packDate(p, (size_t)(dateEnd - p));
+    return 1;
+}
+
+static THREAD_FUNC(countLines, arg) {
+    LoadChunk* chunk = (LoadChunk*)arg;
+    const char* p = chunk->begin;
+    size_t lines = 0;
+    while (p < chunk->end) {
+        const char* nl = (const char*)memchr(p, '\n', (size_t)(chunk->end - p));
+        lines++;
+        p = nl ? nl + 1 : chunk->end;
+    }
+    chunk->lines = lines;
+    return 0;
+}
+
+static THREAD_FUNC(parseLines, arg) {
+    LoadChunk* chunk = (LoadChunk*)arg;
+    const char* p = chunk->begin;
+    while (p < chunk->end) {
+        const char* nl = (const char*)memchr(p, '\n', (size_t)(chunk->end - p));
+        const char* lineEnd = nl ? nl : chunk->end;
+        if (parseTaskLine(p, lineEnd, chunk)) {
+            int id = store.ids[chunk->first + chunk->parsed];
+            if (id > chunk->maxId) chunk->maxId = id;
+            chunk->parsed++;
+        }
+        p = nl ? nl + 1 : chunk->end;
+    }
+    return 0;
+}
+
+// Run body over every chunk, the first on this thread and the rest on
+// their own, falling back to this thread where none can be started
+static void forEachChunk(ThreadBody body, LoadChunk* chunks, size_t count) {
+    ThreadHandle* threads = (ThreadHandle*)malloc(count * sizeof(ThreadHandle));
+    HANDLE_MEMORY_ERROR(threads);
+    int* started = (int*)calloc(count, sizeof(int));
+    HANDLE_MEMORY_ERROR(started);
+    for (size_t i = 1; i < count; i++) started[i] = startThread(&threads[i], body, &chunks[i]);
+    body(&chunks[0]);
+    for (size_t i = 1; i < count; i++) {
+        if (started[i]) {
+            joinThread(threads[i]);
+        } else {
+            body(&chunks[i]);
+        }
+    }
+    free(started);
+    free(threads);
+}
+
+// Load the snapshot into the store, without building the indexes. The
+// file is mapped and cut at line boundaries into one chunk per thread. The
+// threads count their chunk's lines, which places every chunk in the
+// store, then parse their lines straight into place; the parsed runs of
+// slots and of description text are closed up at the end, and the arena
+// trimmed to fit. Returns 0 if there is no snapshot.
+static int loadSnapshot(int* maxId) {
+    MappedFile file;
+    if (!mapFile(TASKS_FILE, &file)) return 0;
+
+    size_t threads = file.size / LOAD_CHUNK_BYTES + 1;
+    if (threads > cpuCount()) threads = cpuCount();
+    LoadChunk* chunks = (LoadChunk*)calloc(threads, sizeof(LoadChunk));
+    HANDLE_MEMORY_ERROR(chunks);
+    const char* end = file.data + file.size;
+    const char* p = file.data;
+    for (size_t i = 0; i < threads; i++) {
+        const char* cut = i + 1 == threads ? end : file.data + file.size / threads * (i + 1);
+        if (cut < p) cut = p;
+        const char* nl = cut < end ? (const char*)memchr(cut, '\n', (size_t)(end - cut)) : NULL;
+        chunks[i].begin = p;
+        chunks[i].end = i + 1 == threads || nl == NULL ? end : nl + 1;
+        chunks[i].arenaFirst = file.size > 0 ? (size_t)(p - file.data) : 0;
+        p = chunks[i].end;
+    }
+
+    forEachChunk(countLines, chunks, threads);
+    size_t lines = 0;
+    for (size_t i = 0; i < threads; i++) {
+        chunks[i].first = lines;
+        lines += chunks[i].lines;
+    }
+    reserveTasks(lines);
+    reserveArena(file.size + 1);
+    forEachChunk(parseLines, chunks, threads);
+
+    size_t truncated = 0;
+    for (size_t i = 0; i < threads; i++) {
+        LoadChunk* chunk = &chunks[i];
+        uint16_t* codes = (uint16_t*)malloc((chunk->statusCount ? chunk->statusCount : 1) * sizeof(uint16_t));
+        HANDLE_MEMORY_ERROR(codes);
+        for (size_t k = 0; k < chunk->statusCount; k++) codes[k] = internStatus(chunk->statusNames[k]);
+        if (store.arenaUsed + chunk->descBytes > UINT32_MAX) {
+            fprintf(stderr, "Too much description text to store\n");
+            exit(EXIT_FAILURE);
+        }
+        memmove(store.arena + store.arenaUsed, store.arena + chunk->arenaFirst, chunk->descBytes);
+        for (size_t j = 0; j < chunk->parsed; j++) {
+            size_t from = chunk->first + j, to = store.count + j;
+            store.ids[to] = store.ids[from];
+            store.priorities[to] = store.priorities[from];
+            store.statusCodes[to] = codes[store.statusCodes[from]];
+            store.dates[to] = store.dates[from];
+            store.descOffsets[to] = (uint32_t)(store.arenaUsed + store.descOffsets[from]);
+        }
+        store.count += chunk->parsed;
+        store.arenaUsed += chunk->descBytes;
+        truncated += chunk->truncated;
+        if (chunk->maxId > *maxId) *maxId = chunk->maxId;
+        free(codes);
+        free(chunk->statusNames);
+    }
+    store.arena = (char*)growColumn(store.arena, store.arenaUsed ? store.arenaUsed : 1, 1);
+    store.arenaCapacity = store.arenaUsed ? store.arenaUsed : 1;
+    if (truncated > 0) {
+        printf("%zu task fields were too long and have been shortened.\n", truncated);
+    }
+    snapshotBytes = (long)file.size;
+    free(chunks);
+    unmapFile(&file);
+    return 1;
+}
+
+// Load the snapshot and replay the journals: load every snapshot line,
+// build the indexes once, then apply the journals' changes in order
 void loadFromFile() {
-    FILE* file = fopen("tasks.txt", "r");
-    if (file == NULL) {
+    clearTaskList(); // Clear existing tasks before loading
+    
+    int maxId = 0;
+    if (!loadSnapshot(&maxId)) {
         printf("No existing tasks file found.\n");
-        return;
     }
+    rebuildIndexes();
     
-    clearTaskList(); // Clear existing list before loading
-    
-    char line[MAX_LINE];
-    int maxId = 0;
+    // Records from a compaction that did not finish come first. Replaying
+    // them over the new snapshot, if it was written, changes nothing.
+    int clean = replayJournal(JOURNAL_OLD_FILE, &maxId);
+    clean = replayJournal(JOURNAL_FILE, &maxId) && clean;
+    nextId = maxId + 1;
     
-    while (fgets(line, MAX_LINE, file)) {
-        char desc[MAX_TASK_DESC];
-        int id, priority;
-        char status[20], date[11];
-        
-        sscanf(line, "%d|%[^|]|%d|%[^|]|%s\n",
-               &id, desc, &priority, status, date);
-        
-        Task* newTask = createTask(id, desc, priority, status, date);
-        
-        // Keep track of highest ID for nextId
-        if (id > maxId) maxId = id;
-        
-        // Add to list in sorted order
-        if (taskList == NULL || taskList->priority > priority) {
-            newTask->next = taskList;
-            taskList = newTask;
-        } else {
-            Task* current = taskList;
-            while (current->next != NULL && current->next->priority <= priority) {
-                current = current->next;
-            }
-            newTask->next = current->next;
-            current->next = newTask;
+    // New records must not follow a torn one, so start over from a snapshot
+    if (!clean) {
+        printf("Journal was damaged; recovered the tasks up to the damage.\n");
+        long bytes = saveToFile(SNAPSHOT_TMP_FILE, &store);
+        if (bytes >= 0 && replaceFile(SNAPSHOT_TMP_FILE, TASKS_FILE)) {
+            remove(JOURNAL_OLD_FILE);
+            remove(JOURNAL_FILE);
+            snapshotBytes = bytes;
         }
     }
-    
-    nextId = maxId + 1;
-    fclose(file);
+    openJournal();
 }
 
-// Clear the task list
-void clearTaskList() {
-    while (taskList != NULL) {
-        Task* temp = taskList;
-        taskList = taskList->next;
-        free(temp);
+// Flush the journal to disk and wait for any compaction, before exit
+void closeJournal() {
+    waitForCompaction();
+    if (journal != NULL) {
+        syncFile(journal);
+        fclose(journal);
+        journal = NULL;
     }
 }
 
+// Free everything a store holds and empty it
+void freeStore(TaskStore* tasks) {
+    free(tasks->ids);
+    free(tasks->priorities);
+    free(tasks->statusCodes);
+    free(tasks->dates);
+    free(tasks->descOffsets);
+    free(tasks->arena);
+    free(tasks->index);
+    free(tasks->heap);
+    free(tasks->heapPos);
+    for (int p = 0; p < 5; p++) free(tasks->priorityBits[p]);
+    for (size_t i = 0; i < tasks->statusCount; i++) free(tasks->statuses[i].bits);
+    free(tasks->statuses);
+    free(tasks->byDate);
+    memset(tasks, 0, sizeof(*tasks));
+}
+
+// Clear all tasks and free the store
+void clearTaskList() {
+    freeStore(&store);
+}
+
 // Main function
 int main() {
     int choice;
@@ -343,7 +1786,8 @@ int main() {
         printf("2. View Tasks\n");
         printf("3. Update Task Status\n");
         printf("4. Delete Task\n");
-        printf("5. Exit\n");
+        printf("5. Query Tasks\n");
+        printf("6. Exit\n");
         printf("Enter your choice: ");
         
         if (scanf("%d", &choice) != 1) {
@@ -367,7 +1811,11 @@ int main() {
                 deleteTask();
                 break;
             case 5:
+                queryTasks();
+                break;
+            case 6:
                 printf("\nExiting...\n");
+                closeJournal();
                 clearTaskList();
                 return 0;
             default:
@@ -1,412 +1,16 @@
-into the #define NOMINMAX
-#include <windows.h>
-#include <algorithm>
+// Expression Engine Function Tests
+// Compile with: g++ -std=c++17 test_all_functions.cpp -o test_all_functions.exe
+
 #include <cmath>
-#include <cctype>
-#include <functional>
-#include <map>
-#include <sstream>
-#include <stdexcept>
-#include <string>
-#include <vector>
-#include <cwctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <string>
+#include <vector>
+#include "expression_engine.h"
 
-constexpr double kPi = 3.14159265358979323846;
-constexpr double kE = 2.71828182845904523536;
-
-enum class AngleMode { Radians, Degrees };
-
-struct FunctionSpec {
-    int arity;
-    std::function<double(const std::vector<double>&, AngleMode)> apply;
-};
-
-struct OperatorInfo {
-    int precedence;
-    bool rightAssociative;
-    int arity;
-};
-
-class ExpressionEngine {
-public:
-    ExpressionEngine() {
-        ops_[L"+"] = {2, false, 2};
-        ops_[L"-"] = {2, false, 2};
-        ops_[L"*"] = {3, false, 2};
-        ops_[L"/"] = {3, false, 2};
-        ops_[L"%"] = {3, false, 2};
-        ops_[L"^"] = {4, true, 2};
-        ops_[L"u+"] = {5, true, 1};
-        ops_[L"u-"] = {5, true, 1};
-        ops_[L"!"] = {6, false, 1};
-
-        funcs_[L"sin"] = {1, [](const std::vector<double>& a, AngleMode m) { return std::sin(toRad(a[0], m)); }};
-        funcs_[L"cos"] = {1, [](const std::vector<double>& a, AngleMode m) { return std::cos(toRad(a[0], m)); }};
-        funcs_[L"tan"] = {1, [](const std::vector<double>& a, AngleMode m) { return std::tan(toRad(a[0], m)); }};
-        funcs_[L"asin"] = {1, [](const std::vector<double>& a, AngleMode m) {
-                             if (a[0] < -1.0 || a[0] > 1.0) throw std::runtime_error("asin domain [-1,1]");
-                             double r = std::asin(a[0]);
-                             return m == AngleMode::Degrees ? (r * 180.0 / kPi) : r;
-                         }};
-        funcs_[L"acos"] = {1, [](const std::vector<double>& a, AngleMode m) {
-                             if (a[0] < -1.0 || a[0] > 1.0) throw std::runtime_error("acos domain [-1,1]");
-                             double r = std::acos(a[0]);
-                             return m == AngleMode::Degrees ? (r * 180.0 / kPi) : r;
-                         }};
-        funcs_[L"atan"] = {1, [](const std::vector<double>& a, AngleMode m) {
-                             double r = std::atan(a[0]);
-                             return m == AngleMode::Degrees ? (r * 180.0 / kPi) : r;
-                         }};
-        funcs_[L"sqrt"] = {1, [](const std::vector<double>& a, AngleMode) {
-                             if (a[0] < 0.0) throw std::runtime_error("sqrt domain x>=0");
-                             return std::sqrt(a[0]);
-                         }};
-        funcs_[L"ln"] = {1, [](const std::vector<double>& a, AngleMode) {
-                           if (a[0] <= 0.0) throw std::runtime_error("ln domain x>0");
-                           return std::log(a[0]);
-                       }};
-        funcs_[L"log"] = {1, [](const std::vector<double>& a, AngleMode) {
-                            if (a[0] <= 0.0) throw std::runtime_error("log domain x>0");
-                            return std::log10(a[0]);
-                        }};
-        funcs_[L"abs"] = {1, [](const std::vector<double>& a, AngleMode) { return std::fabs(a[0]); }};
-        funcs_[L"pow"] = {2, [](const std::vector<double>& a, AngleMode) { return std::pow(a[0], a[1]); }};
-        funcs_[L"min"] = {2, [](const std::vector<double>& a, AngleMode) { return std::min(a[0], a[1]); }};
-        funcs_[L"max"] = {2, [](const std::vector<double>& a, AngleMode) { return std::max(a[0], a[1]); }};
-
-        // Electrical Engineering Functions - Ohm's Law & Power
-        funcs_[L"pvi"] = {2, [](const std::vector<double>& a, AngleMode) { return a[0] * a[1]; }};
-        funcs_[L"pir"] = {2, [](const std::vector<double>& a, AngleMode) { return a[0] * a[0] * a[1]; }};
-        funcs_[L"pvr"] = {2, [](const std::vector<double>& a, AngleMode) { return (a[0] * a[0]) / a[1]; }};
-        funcs_[L"vir"] = {2, [](const std::vector<double>& a, AngleMode) { return a[0] * a[1]; }};
-        funcs_[L"ivr"] = {2, [](const std::vector<double>& a, AngleMode) { return a[0] / a[1]; }};
-        funcs_[L"rvi"] = {2, [](const std::vector<double>& a, AngleMode) { return a[0] / a[1]; }};
-
-        // Additional derived calculations
-        funcs_[L"vpi"] = {2, [](const std::vector<double>& a, AngleMode) { return a[0] / a[1]; }};
-        funcs_[L"ipv"] = {2, [](const std::vector<double>& a, AngleMode) { return a[0] / a[1]; }};
-        funcs_[L"rpi"] = {2, [](const std::vector<double>& a, AngleMode) { return (a[0] / (a[1] * a[1])); }};
-        funcs_[L"rpv"] = {2, [](const std::vector<double>& a, AngleMode) { return (a[1] * a[1]) / a[0]; }};
-        funcs_[L"vpr"] = {2, [](const std::vector<double>& a, AngleMode) { return std::sqrt(a[0] * a[1]); }};
-        funcs_[L"ipr"] = {2, [](const std::vector<double>& a, AngleMode) { return std::sqrt(a[0] / a[1]); }};
-
-        // AC Power Functions
-        funcs_[L"preal"] = {3, [](const std::vector<double>& a, AngleMode m) {
-                             double angle = toRad(a[2], m);
-                             return a[0] * a[1] * std::cos(angle);
-                         }};
-        funcs_[L"preact"] = {3, [](const std::vector<double>& a, AngleMode m) {
-                              double angle = toRad(a[2], m);
-                              return a[0] * a[1] * std::sin(angle);
-                          }};
-        funcs_[L"papp"] = {2, [](const std::vector<double>& a, AngleMode) { return a[0] * a[1]; }};
-        funcs_[L"pf"] = {1, [](const std::vector<double>& a, AngleMode m) {
-                          double angle = toRad(a[0], m);
-                          return std::cos(angle);
-                      }};
-
-        // Impedance & Reactance
-        funcs_[L"zrx"] = {2, [](const std::vector<double>& a, AngleMode) {
-                           return std::sqrt(a[0] * a[0] + a[1] * a[1]);
-                       }};
-        funcs_[L"xc"] = {2, [](const std::vector<double>& a, AngleMode) {
-                          if (a[0] <= 0 || a[1] <= 0) throw std::runtime_error("xc args must be > 0");
-                          return 1.0 / (2.0 * kPi * a[0] * a[1]);
-                      }};
-        funcs_[L"xl"] = {2, [](const std::vector<double>& a, AngleMode) {
-                          if (a[0] < 0 || a[1] < 0) throw std::runtime_error("xl args must be >= 0");
-                          return 2.0 * kPi * a[0] * a[1];
-                      }};
-
-        // Resonant Frequency
-        funcs_[L"fres"] = {2, [](const std::vector<double>& a, AngleMode) {
-                            if (a[0] <= 0 || a[1] <= 0) throw std::runtime_error("fres args must be > 0");
-                            return 1.0 / (2.0 * kPi * std::sqrt(a[0] * a[1]));
-                        }};
-
-        // Decibel Calculations
-        funcs_[L"dbv"] = {2, [](const std::vector<double>& a, AngleMode) {
-                           if (a[0] <= 0 || a[1] <= 0) throw std::runtime_error("dbv args must be > 0");
-                           return 20.0 * std::log10(a[0] / a[1]);
-                       }};
-        funcs_[L"dbp"] = {2, [](const std::vector<double>& a, AngleMode) {
-                           if (a[0] <= 0 || a[1] <= 0) throw std::runtime_error("dbp args must be > 0");
-                           return 10.0 * std::log10(a[0] / a[1]);
-                       }};
-
-        // Voltage Divider
-        funcs_[L"vdiv"] = {3, [](const std::vector<double>& a, AngleMode) {
-                            if (a[1] + a[2] == 0) throw std::runtime_error("vdiv R1+R2 cannot be 0");
-                            return a[0] * a[2] / (a[1] + a[2]);
-                        }};
-
-        // Calculus Functions
-        funcs_[L"sum"] = {1, [](const std::vector<double>& a, AngleMode) {
-                           if (a[0] < 0 || !isNearlyInt(a[0])) throw std::runtime_error("sum needs integer >= 0");
-                           double n = std::round(a[0]);
-                           return n * (n + 1) / 2.0;
-                       }};
-        funcs_[L"sum2"] = {1, [](const std::vector<double>& a, AngleMode) {
-                            if (a[0] < 0 || !isNearlyInt(a[0])) throw std::runtime_error("sum2 needs integer >= 0");
-                            double n = std::round(a[0]);
-                            return n * (n + 1) * (2 * n + 1) / 6.0;
-                        }};
-        funcs_[L"sum3"] = {1, [](const std::vector<double>& a, AngleMode) {
-                            if (a[0] < 0 || !isNearlyInt(a[0])) throw std::runtime_error("sum3 needs integer >= 0");
-                            double n = std::round(a[0]);
-                            double t = n * (n + 1) / 2.0;
-                            return t * t;
-                        }};
-        funcs_[L"geom"] = {3, [](const std::vector<double>& a, AngleMode) {
-                            double a0 = a[0], r = a[1], n = a[2];
-                            if (std::fabs(r - 1.0) < 1e-12) return a0 * (n + 1);
-                            return a0 * (1.0 - std::pow(r, n + 1)) / (1.0 - r);
-                        }};
-        funcs_[L"intpow"] = {3, [](const std::vector<double>& a, AngleMode) {
-                             double lo = a[0], hi = a[1], k = a[2];
-                             if (std::fabs(k + 1) < 1e-12) {
-                                 if (lo <= 0 || hi <= 0) throw std::runtime_error("intpow: x must be > 0 for k=-1");
-                                 return std::log(hi) - std::log(lo);
-                             }
-                             return (std::pow(hi, k + 1) - std::pow(lo, k + 1)) / (k + 1);
-                         }};
-        funcs_[L"intexp"] = {2, [](const std::vector<double>& a, AngleMode) {
-                             return std::exp(a[1]) - std::exp(a[0]);
-                         }};
-        funcs_[L"intsin"] = {2, [](const std::vector<double>& a, AngleMode) {
-                             return -std::cos(a[1]) + std::cos(a[0]);
-                         }};
-        funcs_[L"intcos"] = {2, [](const std::vector<double>& a, AngleMode) {
-                             return std::sin(a[1]) - std::sin(a[0]);
-                         }};
-        funcs_[L"intlog"] = {2, [](const std::vector<double>& a, AngleMode) {
-                             if (a[0] <= 0 || a[1] <= 0) throw std::runtime_error("intlog: bounds must be > 0");
-                             return std::log(a[1]) - std::log(a[0]);
-                         }};
-        funcs_[L"derivpow"] = {3, [](const std::vector<double>& a, AngleMode) {
-                               double x = a[0], n = a[1], h = a[2];
-                               if (h <= 0) h = 1e-6;
-                               double fxh = std::pow(x + h, n);
-                               double fxmh = std::pow(x - h, n);
-                               return (fxh - fxmh) / (2 * h);
-                           }};
-        funcs_[L"derivexp"] = {2, [](const std::vector<double>& a, AngleMode) {
-                               double x = a[0], h = a[1];
-                               if (h <= 0) h = 1e-6;
-                               return (std::exp(x + h) - std::exp(x - h)) / (2 * h);
-                           }};
-        funcs_[L"derivsin"] = {2, [](const std::vector<double>& a, AngleMode) {
-                               double x = a[0], h = a[1];
-                               if (h <= 0) h = 1e-6;
-                               return (std::sin(x + h) - std::sin(x - h)) / (2 * h);
-                           }};
-        funcs_[L"derivcos"] = {2, [](const std::vector<double>& a, AngleMode) {
-                               double x = a[0], h = a[1];
-                               if (h <= 0) h = 1e-6;
-                               return (std::cos(x + h) - std::cos(x - h)) / (2 * h);
-                           }};
-        funcs_[L"derivln"] = {2, [](const std::vector<double>& a, AngleMode) {
-                              double x = a[0], h = a[1];
-                              if (h <= 0) h = 1e-6;
-                              if (x - h <= 0) throw std::runtime_error("derivln: x-h must be > 0");
-                              return (std::log(x + h) - std::log(x - h)) / (2 * h);
-                          }};
-        funcs_[L"limpow"] = {3, [](const std::vector<double>& a, AngleMode) {
-                             double x0 = a[0], n = a[1], dir = a[2];
-                             double eps = 1e-10;
-                             double x = x0 + (dir >= 0 ? eps : -eps);
-                             return std::pow(x, n);
-                         }};
-    }
-
-    double evaluate(const std::wstring& expr, AngleMode mode, double ans, double mem) const {
-        std::map<std::wstring, double> vars{{L"pi", kPi}, {L"e", kE}, {L"ans", ans}, {L"mem", mem}};
-        auto tokens = tokenize(expr);
-        tokens = insertImplicitMult(tokens);
-        auto rpn = toRpn(tokens);
-        return evalRpn(rpn, mode, vars);
-    }
-
-private:
-    enum class TT { Number, Name, Operator, LParen, RParen, Comma };
-    struct Tok {
-        TT type;
-        std::wstring text;
-        double n = 0.0;
-    };
-
-    std::map<std::wstring, OperatorInfo> ops_;
-    std::map<std::wstring, FunctionSpec> funcs_;
-
-    static double toRad(double x, AngleMode m) {
-        return m == AngleMode::Degrees ? (x * kPi / 180.0) : x;
-    }
-
-    static bool isNearlyInt(double x) {
-        return std::fabs(x - std::round(x)) < 1e-12;
-    }
-
-    static double factorial(double x) {
-        if (x < 0 || !isNearlyInt(x)) throw std::runtime_error("factorial needs integer >= 0");
-        long long n = static_cast<long long>(std::llround(x));
-        if (n > 170) throw std::runtime_error("factorial too large (>170)");
-        double r = 1.0;
-        for (long long i = 2; i <= n; ++i) r *= i;
-        return r;
-    }
-
-    static std::wstring lower(std::wstring s) {
-        std::transform(s.begin(), s.end(), s.begin(), [](wchar_t c) {
-            return static_cast<wchar_t>(std::towlower(c));
-        });
-        return s;
-    }
-
-    std::vector<Tok> tokenize(const std::wstring& e) const {
-        std::vector<Tok> t;
-        for (size_t i = 0; i < e.size();) {
-            wchar_t c = e[i];
-            if (iswspace(c)) { ++i; continue; }
-            if (iswdigit(c) || c == L'.') {
-                size_t j = i;
-                bool dot = false;
-                while (j < e.size()) {
-                    wchar_t d = e[j];
-                    if (d == L'.') { if (dot) break; dot = true; ++j; }
-                    else if (iswdigit(d)) ++j;
-                    else break;
-                }
-                auto s = e.substr(i, j - i);
-                t.push_back({TT::Number, s, std::stod(std::string(s.begin(), s.end()))});
-                i = j; continue;
-            }
-            if (iswalpha(c) || c == L'_') {
-                size_t j = i;
-                while (j < e.size() && (iswalnum(e[j]) || e[j] == L'_')) ++j;
-                t.push_back({TT::Name, lower(e.substr(i, j - i)), 0.0});
-                i = j; continue;
-            }
-            if (c == L'+' || c == L'-' || c == L'*' || c == L'/' || c == L'^' || c == L'%' || c == L'!') {
-                t.push_back({TT::Operator, std::wstring(1, c), 0.0}); ++i; continue;
-            }
-            if (c == L'(') { t.push_back({TT::LParen, L"(", 0.0}); ++i; continue; }
-            if (c == L')') { t.push_back({TT::RParen, L")", 0.0}); ++i; continue; }
-            if (c == L',') { t.push_back({TT::Comma, L",", 0.0}); ++i; continue; }
-            throw std::runtime_error("invalid character");
-        }
-        return t;
-    }
-
-    std::vector<Tok> insertImplicitMult(const std::vector<Tok>& in) const {
-        std::vector<Tok> out;
-        for (size_t i = 0; i < in.size(); ++i) {
-            out.push_back(in[i]);
-            if (i + 1 < in.size()) {
-                const Tok& cur = in[i];
-                const Tok& nxt = in[i + 1];
-                bool curVal = (cur.type == TT::Number || cur.type == TT::RParen ||
-                              (cur.type == TT::Operator && cur.text == L"!") ||
-                              (cur.type == TT::Name && funcs_.find(cur.text) == funcs_.end()));
-                bool nxtVal = (nxt.type == TT::Number || nxt.type == TT::LParen || nxt.type == TT::Name);
-                if (curVal && nxtVal) out.push_back({TT::Operator, L"*", 0.0});
-            }
-        }
-        return out;
-    }
-
-    std::vector<Tok> toRpn(const std::vector<Tok>& in) const {
-        std::vector<Tok> out, st;
-        bool expectUnary = true;
-        for (size_t i = 0; i < in.size(); ++i) {
-            Tok tk = in[i];
-            if (tk.type == TT::Number) { out.push_back(tk); expectUnary = false; continue; }
-            if (tk.type == TT::Name) {
-                bool isFunc = (i + 1 < in.size() && in[i + 1].type == TT::LParen);
-                if (isFunc) st.push_back(tk); else out.push_back(tk);
-                expectUnary = false; continue;
-            }
-            if (tk.type == TT::Comma) {
-                while (!st.empty() && st.back().type != TT::LParen) { out.push_back(st.back()); st.pop_back(); }
-                if (st.empty()) throw std::runtime_error("misplaced comma");
-                expectUnary = true; continue;
-            }
-            if (tk.type == TT::Operator) {
-                if ((tk.text == L"+" || tk.text == L"-") && expectUnary) tk.text = (tk.text == L"+") ? L"u+" : L"u-";
-                auto cur = ops_.find(tk.text);
-                if (cur == ops_.end()) throw std::runtime_error("unsupported operator");
-                while (!st.empty() && st.back().type == TT::Operator) {
-                    auto top = ops_.find(st.back().text);
-                    if (top == ops_.end()) break;
-                    bool pop = cur->second.rightAssociative ? (cur->second.precedence < top->second.precedence)
-                                                            : (cur->second.precedence <= top->second.precedence);
-                    if (!pop) break;
-                    out.push_back(st.back()); st.pop_back();
-                }
-                st.push_back(tk); expectUnary = tk.text != L"!"; continue;
-            }
-            if (tk.type == TT::LParen) { st.push_back(tk); expectUnary = true; continue; }
-            if (tk.type == TT::RParen) {
-                bool found = false;
-                while (!st.empty()) {
-                    Tok top = st.back(); st.pop_back();
-                    if (top.type == TT::LParen) { found = true; break; }
-                    out.push_back(top);
-                }
-                if (!found) throw std::runtime_error("mismatched parentheses");
-                if (!st.empty() && st.back().type == TT::Name) { out.push_back(st.back()); st.pop_back(); }
-                expectUnary = false;
-            }
-        }
-        while (!st.empty()) {
-            if (st.back().type == TT::LParen) throw std::runtime_error("mismatched parentheses");
-            out.push_back(st.back()); st.pop_back();
-        }
-        return out;
-    }
-
-    double evalRpn(const std::vector<Tok>& rpn, AngleMode mode, const std::map<std::wstring, double>& vars) const {
-        std::vector<double> st;
-        for (const auto& tk : rpn) {
-            if (tk.type == TT::Number) st.push_back(tk.n);
-            else if (tk.type == TT::Name) {
-                auto f = funcs_.find(tk.text);
-                if (f != funcs_.end()) {
-                    int a = f->second.arity;
-                    if (static_cast<int>(st.size()) < a) throw std::runtime_error("not enough function args");
-                    std::vector<double> args(a);
-                    for (int i = a - 1; i >= 0; --i) { args[i] = st.back(); st.pop_back(); }
-                    st.push_back(f->second.apply(args, mode));
-                } else {
-                    auto v = vars.find(tk.text);
-                    if (v == vars.end()) throw std::runtime_error("unknown identifier");
-                    st.push_back(v->second);
-                }
-            } else if (tk.type == TT::Operator) {
-                int a = ops_.at(tk.text).arity;
-                if (static_cast<int>(st.size()) < a) throw std::runtime_error("not enough operands");
-                if (a == 1) {
-                    double x = st.back(); st.pop_back();
-                    if (tk.text == L"u+") st.push_back(+x);
-                    else if (tk.text == L"u-") st.push_back(-x);
-                    else if (tk.text == L"!") st.push_back(factorial(x));
-                } else {
-                    double b = st.back(); st.pop_back();
-                    double a1 = st.back(); st.pop_back();
-                    if (tk.text == L"+") st.push_back(a1 + b);
-                    else if (tk.text == L"-") st.push_back(a1 - b);
-                    else if (tk.text == L"*") st.push_back(a1 * b);
-                    else if (tk.text == L"/") { if (std::fabs(b) < 1e-15) throw std::runtime_error("division by zero"); st.push_back(a1 / b); }
-                    else if (tk.text == L"%") { if (std::fabs(b) < 1e-15) throw std::runtime_error("modulo by zero"); st.push_back(std::fmod(a1, b)); }
-                    else if (tk.text == L"^") st.push_back(std::pow(a1, b));
-                }
-            }
-        }
-        if (st.size() != 1) throw std::runtime_error("invalid expression");
-        return st.back();
-    }
-};
 
 int testsPassed = 0;
 int testsFailed = 0;
@@ -430,6 +34,58 @@ void test(const char* name, const std::wstring& expr, double expected, AngleMode
     }
 }
 
+void testArray(const char* name, const std::wstring& expr, const std::vector<double>& expected,
+               AngleMode mode = AngleMode::Radians, double tolerance = 1e-6) {
+    ExpressionEngine engine;
+    try {
+        Value result = engine.evaluateValue(expr, mode, 0, 0);
+        bool pass = result.isArray && result.arr.size() == expected.size();
+        for (size_t i = 0; pass && i < expected.size(); ++i) pass = std::fabs(result.arr[i] - expected[i]) < tolerance;
+        if (pass) {
+            std::cout << "[PASS] " << name << ": " << std::string(expr.begin(), expr.end()) << "\n";
+            testsPassed++;
+        } else {
+            std::cout << "[FAIL] " << name << ": " << std::string(expr.begin(), expr.end()) << " got [";
+            for (size_t i = 0; i < result.size(); ++i) std::cout << (i ? ", " : "") << result.at(i);
+            std::cout << "]\n";
+            testsFailed++;
+        }
+    } catch (const std::exception& e) {
+        std::cout << "[FAIL] " << name << ": " << std::string(expr.begin(), expr.end())
+                  << " threw exception: " << e.what() << "\n";
+        testsFailed++;
+    }
+}
+
+void testElement(const char* name, const std::wstring& expr, size_t index, double expected,
+                 AngleMode mode = AngleMode::Radians, double tolerance = 1e-9) {
+    ExpressionEngine engine;
+    try {
+        Value result = engine.evaluateValue(expr, mode, 0, 0);
+        double got = index < result.size() ? result.at(index) : std::nan("");
+        bool pass = got == expected || std::fabs(got - expected) < tolerance;
+        std::cout << (pass ? "[PASS] " : "[FAIL] ") << name << ": " << std::string(expr.begin(), expr.end())
+                  << "[" << index << "] = " << got << "\n";
+        (pass ? testsPassed : testsFailed)++;
+    } catch (const std::exception& e) {
+        std::cout << "[FAIL] " << name << ": " << std::string(expr.begin(), expr.end())
+                  << " threw exception: " << e.what() << "\n";
+        testsFailed++;
+    }
+}
+
+void testThrows(const char* name, const std::wstring& expr, AngleMode mode = AngleMode::Radians) {
+    ExpressionEngine engine;
+    try {
+        engine.evaluateValue(expr, mode, 0, 0);
+        std::cout << "[FAIL] " << name << ": " << std::string(expr.begin(), expr.end()) << " did not throw\n";
+        testsFailed++;
+    } catch (const std::exception&) {
+        std::cout << "[PASS] " << name << ": " << std::string(expr.begin(), expr.end()) << " throws\n";
+        testsPassed++;
+    }
+}
+
 int main() {
     std::cout << std::fixed << std::setprecision(6);
     std::cout << "=== CALCULATOR FUNCTION TESTS ===\n\n";
@@ -516,6 +172,181 @@ int main() {
     test("sum3(5)", L"sum3(5)", 225);
     test("geom(1,2,3)", L"geom(1,2,3)", 15);  // 1+2+4+8=15
 
+    std::cout << "\n--- Combinatorics ---\n";
+    test("nCr(10,3)", L"nCr(10,3)", 120);
+    test("nPr(5,2)", L"nPr(5,2)", 20);
+    test("nCr(5,7)", L"nCr(5,7)", 0);
+    test("nCr(1000,500)", L"nCr(1000,500)", 2.7028824094543655e299, AngleMode::Radians, 1e287);
+
+    std::cout << "\n--- Special Functions ---\n";
+    test("gamma(5)", L"gamma(5)", 24, AngleMode::Radians, 1e-14);
+    test("gamma(1/2)^2 = pi", L"gamma(0.5)^2", kPi, AngleMode::Radians, 1e-14);
+    test("gamma(-1.5)", L"gamma(-1.5)", 2.3632718012073547, AngleMode::Radians, 1e-14);
+    test("gamma(171.5)", L"gamma(171.5)", 9.483367566824795e307, AngleMode::Radians, 1e294);
+    test("lgamma(1000)", L"lgamma(1000)", 5905.2204232091808, AngleMode::Radians, 1e-11);
+    test("lgamma(-2.5)", L"lgamma(-2.5)", -0.056243716497674054, AngleMode::Radians, 1e-15);
+    test("Non-integer factorial", L"0.5!", std::sqrt(kPi) / 2, AngleMode::Radians, 1e-15);
+    test("Negative non-integer factorial", L"(-0.5)!", std::sqrt(kPi), AngleMode::Radians, 1e-15);
+    test("erf(1)", L"erf(1)", 0.84270079294971487, AngleMode::Radians, 1e-16);
+    test("erfc(3)", L"erfc(3)", 2.2090496998585441e-5, AngleMode::Radians, 1e-20);
+    test("erfc(-2)", L"erfc(-2)", 1.9953222650189527, AngleMode::Radians, 1e-15);
+    test("beta(2,3)", L"beta(2,3)", 1.0 / 12, AngleMode::Radians, 1e-16);
+    test("beta(50,70)", L"beta(50,70)", 1.8672362180783137e-36, AngleMode::Radians, 1e-49);
+    test("beta past gamma's range", L"beta(-170.5, 180)", -309936844306245.12, AngleMode::Radians, 1e3);
+    test("beta with gamma underflowing", L"beta(-300.5, 400)", -1.0114872532324713e96, AngleMode::Radians, 1e84);
+    test("gammainc(1,1)", L"gammainc(1,1)", 1 - std::exp(-1.0), AngleMode::Radians, 1e-15);
+    test("gammaincc(3,10)", L"gammaincc(3,10)", 61 * std::exp(-10.0), AngleMode::Radians, 1e-17);
+    test("gammainc(0.5,2) = erf(sqrt 2)", L"gammainc(0.5,2) - erf(sqrt(2))", 0, AngleMode::Radians, 1e-15);
+    testArray("gamma over an array", L"gamma([1, 2, 3, 4, 5])", {1, 1, 2, 6, 24}, AngleMode::Radians, 1e-13);
+    testThrows("gamma at a pole", L"gamma(-2)");
+    testThrows("lgamma at a pole in an array", L"lgamma([1, 0])");
+    testThrows("Factorial of a negative integer", L"(-3)!");
+    testThrows("gammainc needs a > 0", L"gammainc(0, 1)");
+    {
+        // Largest errors over random sweeps, against the documented bounds
+        struct Sweep { const char* name; double (*f)(double); long double (*ref)(long double); double lo, hi, bound; };
+        const Sweep sweeps[] = {
+            {"gamma", gammaKernel, [](long double x) { return std::tgamma(x); }, -170, 171.6, 3.5},
+            {"lgamma", lgammaKernel, [](long double x) { return std::lgamma(x); }, 0, 100, 6.5},
+            {"erf", erfKernel, [](long double x) { return std::erf(x); }, -6, 6, 2.6},
+            {"erfc", erfcKernel, [](long double x) { return std::erfc(x); }, -6, 26, 5.5},
+        };
+        for (const Sweep& s : sweeps) {
+            double worst = 0.0;
+            for (int i = 0; i < 20000; ++i) {
+                double x = s.lo + (s.hi - s.lo) * (i + 0.5) / 20000 * (1 + 1e-7 * std::sin(i));
+                long double ref = s.ref(x);
+                double ulp = std::ldexp(1.0, std::ilogb(static_cast<double>(ref)) - 52);
+                worst = std::max(worst, static_cast<double>(std::fabs(s.f(x) - ref) / ulp));
+            }
+            bool pass = worst <= s.bound;
+            std::cout << (pass ? "[PASS] " : "[FAIL] ") << s.name << " within " << s.bound << " ulp (max " << worst << ")\n";
+            (pass ? testsPassed : testsFailed)++;
+        }
+
+        ExpressionEngine engine;
+        Value x = engine.evaluateValue(L"linspace(-3, 9, 1001)", AngleMode::Radians, 0, 0);
+        Value batch = engine.evaluateValue(L"erfc(linspace(-3, 9, 1001))", AngleMode::Radians, 0, 0);
+        bool same = batch.size() == x.size();
+        for (size_t i = 0; same && i < batch.size(); ++i) same = batch.at(i) == erfcKernel(x.at(i));
+        std::cout << (same ? "[PASS] " : "[FAIL] ") << "Batch erfc matches scalar calls exactly\n";
+        (same ? testsPassed : testsFailed)++;
+    }
+
+    std::cout << "\n--- Number Theory ---\n";
+    test("isprime(97)", L"isprime(97)", 1);
+    test("isprime(561), a Carmichael number", L"isprime(561)", 0);
+    test("isprime(2^31-1)", L"isprime(2^31-1)", 1);
+    test("isprime of a negative", L"isprime(-7)", 0);
+    test("gcd(84,36)", L"gcd(84,36)", 12);
+    test("gcd with a negative", L"gcd(-84,36)", 12);
+    test("lcm(4,6)", L"lcm(4,6)", 12);
+    test("modpow(2,100,1e9+7)", L"modpow(2,100,1000000007)", 976371285);
+    test("modpow with a negative base", L"modpow(-2,3,7)", 6);
+    test("modpow with a negative exponent", L"modpow(3,-2,11)", 5);
+    test("modinv(3,11)", L"modinv(3,11)", 4);
+    test("totient(36)", L"totient(36)", 12);
+    test("totient of a prime", L"totient(1000003)", 1000002);
+    testArray("factor(360)", L"factor(360)", {2, 2, 2, 3, 3, 5});
+    testArray("factor of a negative", L"factor(-1001)", {-1, 7, 11, 13});
+    testArray("factor past the prime table", L"factor(600851475143)", {71, 839, 1471, 6857});
+    testArray("factor of a semiprime", L"factor(1000002936999811)", {1000003, 999999937});
+    testArray("isprime over an array", L"isprime([1, 2, 9, 11])", {0, 1, 0, 1});
+    testThrows("gcd needs integers", L"gcd(2.5, 5)");
+    testThrows("modinv needs coprime arguments", L"modinv(6, 9)");
+    testThrows("modpow needs modulus >= 1", L"modpow(2, 3, 0)");
+    testThrows("factor(0)", L"factor(0)");
+    {
+        // Exact mode reads arguments past 2^53 without rounding
+        struct Case { const char* name; std::wstring expr; std::string digits; };
+        std::vector<Case> cases = {
+            {"Largest 64-bit prime", L"isprime(18446744073709551557)", "1"},
+            {"Its even neighbour", L"isprime(18446744073709551556)", "0"},
+            {"Strong pseudoprime to bases 2..37", L"isprime(3825123056546413051)", "0"},
+            {"64-bit modpow", L"modpow(12345678901234567, 98765432109876543, 18446744073709551557)",
+             "13902302290042407341"},
+            {"64-bit modinv", L"modinv(2, 18446744073709551557)", "9223372036854775779"},
+            {"gcd past 2^64", L"gcd(2^100, 6^70)", "1180591620717411303424"},
+            {"lcm past 2^64", L"lcm(2^70, 3^40)", "14353237968448109868972222216943775514624"},
+        };
+        ExpressionEngine engine;
+        for (const Case& c : cases) {
+            std::wstring digits;
+            bool exact = engine.evaluateExact(c.expr, AngleMode::Radians, 0, 0, digits);
+            bool pass = exact && std::string(digits.begin(), digits.end()) == c.digits;
+            std::cout << (pass ? "[PASS] " : "[FAIL] ") << c.name << " (exact): " << std::string(digits.begin(), digits.end()) << "\n";
+            (pass ? testsPassed : testsFailed)++;
+        }
+        Value f = engine.evaluateValue(L"factor(18446744073709551615)", AngleMode::Radians, 0, 0, Precision::Exact);
+        bool pass = f.arr == std::vector<double>{3, 5, 17, 257, 641, 65537, 6700417};
+        std::cout << (pass ? "[PASS] " : "[FAIL] ") << "factor(2^64 - 1) in exact mode\n";
+        (pass ? testsPassed : testsFailed)++;
+
+        // Products of the factors give back n, for random 64-bit n
+        uint64_t n = 88172645463325252ull;
+        pass = true;
+        for (int i = 0; i < 300; ++i) {
+            n ^= n << 13, n ^= n >> 7, n ^= n << 17;
+            uint64_t product = 1;
+            for (uint64_t p : factor64(n)) {
+                pass = pass && isPrime64(p);
+                product *= p;
+            }
+            pass = pass && product == n;
+        }
+        std::cout << (pass ? "[PASS] " : "[FAIL] ") << "factor64 of 300 random 64-bit integers\n";
+        (pass ? testsPassed : testsFailed)++;
+
+        // Past (2^32 - 1)^2, where squaring the root plus one overflows
+        pass = factor64(18446744073709551577ull) == std::vector<uint64_t>{139646831, 132095686967ull} &&
+               totient64(18446744073709551577ull) == 139646830ull * 132095686966ull;
+        std::cout << (pass ? "[PASS] " : "[FAIL] ") << "factor64 of a semiprime near 2^64\n";
+        (pass ? testsPassed : testsFailed)++;
+
+        bool sieve[SMALL_PRIME_LIMIT + 1];
+        sieve_primes(sieve, SMALL_PRIME_LIMIT);
+        size_t k = 0;
+        pass = true;
+        for (int i = 0; i <= SMALL_PRIME_LIMIT; ++i) {
+            if (sieve[i]) pass = pass && k < SMALL_PRIME_COUNT && small_primes[k++] == i;
+            pass = pass && sieve[i] == isPrime64(i);
+        }
+        pass = pass && k == SMALL_PRIME_COUNT;
+        std::cout << (pass ? "[PASS] " : "[FAIL] ") << "Prime table matches the sieve and isprime\n";
+        (pass ? testsPassed : testsFailed)++;
+    }
+    test("primepi(100)", L"primepi(100)", 25);
+    test("primepi of a non-integer", L"primepi(30.5)", 10);
+    test("primepi below 2", L"primepi(-3)", 0);
+    test("primepi(10^9)", L"primepi(1e9)", 50847534);
+    test("nthprime(10000)", L"nthprime(10000)", 104729);
+    test("nthprime(50847534)", L"nthprime(50847534)", 999999937);
+    testArray("primes(10, 30)", L"primes(10, 30)", {11, 13, 17, 19, 23, 29});
+    testArray("primes(10)", L"primes(10)", {2, 3, 5, 7});
+    testArray("primes past 10^9", L"primes(1e9, 1e9+30)", {1000000007, 1000000009, 1000000021});
+    test("Sum over primes(100)", L"sum(primes(100))", 1060);
+    testThrows("nthprime(0)", L"nthprime(0)");
+    testThrows("primepi past 10^12", L"primepi(2e12)");
+    {
+        // Sieve segments end every 983040 numbers, and threads split the count
+        // at segment boundaries: check the primes across two of them
+        const uint64_t from = 983040 - 500, to = 2 * 983040 + 500;
+        PrimeIterator it(from, to);
+        bool pass = true;
+        uint64_t p, expect = from, listed = 0;
+        while (it.next(p)) {
+            for (; expect < p; ++expect) pass = pass && !isPrime64(expect);
+            pass = pass && isPrime64(p);
+            expect = p + 1;
+            ++listed;
+        }
+        for (; expect <= to; ++expect) pass = pass && !isPrime64(expect);
+        pass = pass && primeCount(to, 3) - primeCount(from - 1, 2) == listed;
+        for (uint64_t n = 0; n < 1000; ++n) pass = pass && primeCount(n, 1) == primeCount(n, 4);
+        std::cout << (pass ? "[PASS] " : "[FAIL] ") << "Segmented sieve against isprime across segment edges\n";
+        (pass ? testsPassed : testsFailed)++;
+    }
+
     std::cout << "\n--- Calculus: Integrals ---\n";
     test("∫x³ from 0 to 2", L"intpow(0,2,3)", 4);  // x^4/4 from 0 to 2 = 16/4 = 4
     test("∫x² from 0 to 3", L"intpow(0,3,2)", 9);  // x^3/3 from 0 to 3 = 27/3 = 9
@@ -541,6 +372,652 @@ int main() {
     test("ln(e^2)", L"ln(e^2)", 2);
     test("10^(log(5))", L"10^(log(5))", 5);
 
+    std::cout << "\n--- Arrays ---\n";
+    testArray("List literal", L"[1,2,3]", {1, 2, 3});
+    testArray("Empty list", L"[]", {});
+    testArray("Nested list flattens", L"[[1,2],3]", {1, 2, 3});
+    testArray("linspace(0,1,5)", L"linspace(0,1,5)", {0, 0.25, 0.5, 0.75, 1});
+    testArray("Array + scalar", L"[1,2,3]+1", {2, 3, 4});
+    testArray("Scalar - array", L"10-[1,2,3]", {9, 8, 7});
+    testArray("Array * array", L"[1,2,3]*[4,5,6]", {4, 10, 18});
+    testArray("Array ^ scalar", L"[1,2,3]^2", {1, 4, 9});
+    testArray("Unary minus", L"-[1,2]", {-1, -2});
+    testArray("Factorial", L"[3,4]!", {6, 24});
+    testArray("1-element broadcast", L"[1,2,3]*[2]", {2, 4, 6});
+    testArray("Implicit mult", L"2[1,2]", {2, 4});
+    testArray("pvi column", L"pvi([12,24,48],2)", {24, 48, 96});
+    testArray("vdiv broadcast", L"vdiv(12,[1000,2000],1000)", {6, 4});
+    testArray("sin over array", L"sin([0,pi/2])", {0, 1});
+    testArray("Element-wise max", L"max([1,5],[3,2])", {3, 5});
+    test("sum of array", L"sum([1,2,3,4])", 10);
+    test("sum(n) stays closed form", L"sum(4)", 10);
+    test("mean of array", L"mean([1,2,3,4])", 2.5);
+    test("mean of args", L"mean(1,2,6)", 3);
+    test("max of array", L"max([3,9,2])", 9);
+    test("min of array", L"min([3,9,2])", 2);
+    test("max of 3 args", L"max(3,9,2)", 9);
+    test("sum of linspace", L"sum(linspace(1,100,100))", 5050);
+    testThrows("Size mismatch", L"[1,2]+[1,2,3]");
+    testThrows("Division by zero element", L"1/[1,0]");
+    testThrows("Mismatched bracket", L"[1,2)");
+
+    std::cout << "\n--- Sorting ---\n";
+    testArray("sort", L"sort([3, -1, 2, 0, -0.5])", {-1, -0.5, 0, 2, 3});
+    testArray("sort of args", L"sort(5, [2, 9], 1)", {1, 2, 5, 9});
+    test("median, odd count", L"median([3, 1, 2])", 2);
+    test("median, even count", L"median([4, 1, 3, 2])", 2.5);
+    test("percentile interpolates", L"percentile([1, 2, 3, 4, 5], 30)", 2.2, AngleMode::Radians, 1e-12);
+    testArray("percentiles at once", L"percentile(linspace(0, 1, 101), [0, 50, 90, 100])", {0, 0.5, 0.9, 1}, AngleMode::Radians, 1e-12);
+    testThrows("median of empty array", L"median(primes(1))");
+    testThrows("percentile past 100", L"percentile([1, 2], 101)");
+    {
+        // Introsort, radix sort and the threaded merge against std::sort,
+        // with duplicates, signed zeros and NaN
+        uint64_t state = 99;
+        auto next = [&]() { return state = state * 6364136223846793005ull + 1442695040888963407ull; };
+        bool pass = true;
+        for (size_t n : {size_t(100), size_t(5000), size_t(300001)}) {
+            std::vector<double> v(n);
+            for (double& x : v) x = static_cast<double>(static_cast<int64_t>(next()) >> 50) / 8;
+            v[n / 3] = std::nan("");
+            v[n / 2] = -0.0;
+            std::vector<double> expected = v;
+            std::sort(expected.begin(), expected.end(), sortLess);
+            for (unsigned threads : {1u, 3u, 8u}) {
+                std::vector<double> got = v;
+                parallelSort(got.data(), n, threads);
+                for (size_t i = 0; pass && i < n; ++i)
+                    pass = got[i] == expected[i] || (std::isnan(got[i]) && std::isnan(expected[i]));
+            }
+            std::vector<double> picked = v;
+            introsort_doubles_select(picked.data(), n, n / 4);
+            pass = pass && picked[n / 4] == expected[n / 4];
+        }
+        std::cout << (pass ? "[PASS] " : "[FAIL] ") << "Sorts match std::sort on 1 to 8 threads, NaN last\n";
+        (pass ? testsPassed : testsFailed)++;
+    }
+
+    std::cout << "\n--- Lazy Ranges ---\n";
+    test("Scientific notation", L"1e3+2.5E-1", 1000.25);
+    test("2e is still 2*e", L"2e", 2 * kE);
+    test("sum(n, n, 1, 100)", L"sum(n, n, 1, 100)", 5050);
+    test("sum(n^2, n, 1, 10)", L"sum(n^2, n, 1, 10)", 385);
+    test("sum(1/n^2, n, 1, 1e6)", L"sum(1/n^2, n, 1, 1e6)", kPi * kPi / 6 - 1e-6, AngleMode::Radians, 1e-9);
+    test("Constant body", L"sum(2, k, 1, 1000)", 2000);
+    test("Empty range", L"sum(n, n, 5, 1)", 0);
+    test("prod((n+1)/n, n, 1, 9)", L"prod((n+1)/n, n, 1, 9)", 10, AngleMode::Radians, 1e-9);
+    test("prod(n, n, 1, 10) = 10!", L"prod(n, n, 1, 10)", 3628800);
+    test("Nested sums", L"sum(sum(m*n, m, 1, n), n, 1, 10)", 1705);
+    test("Range uses outer vars", L"sum(pi, n, 1, 2)", 2 * kPi);
+    test("Reduction as a term", L"sum(sum(n), n, 1, 3)", 10);
+    {
+        ExpressionEngine one, many;
+        one.setThreadCount(1);
+        many.setThreadCount(7);
+        const std::wstring expr = L"sum((-1)^n/(2n+1), n, 0, 3e6)";
+        double a = one.evaluate(expr, AngleMode::Radians, 0, 0);
+        double b = many.evaluate(expr, AngleMode::Radians, 0, 0);
+        bool same = std::memcmp(&a, &b, sizeof a) == 0;
+        std::cout << (same ? "[PASS] " : "[FAIL] ") << "Bit-identical across thread counts: " << a << "\n";
+        (same ? testsPassed : testsFailed)++;
+    }
+    testThrows("Index must be a name", L"sum(n, 2, 1, 10)");
+
+    std::cout << "\n--- Summation Accuracy ---\n";
+    test("Pairwise sum of 0.1", L"sum(0.1, n, 1, 1e6)", 100000, AngleMode::Radians, 1e-9);
+    test("Pairwise array sum", L"sum(linspace(0.1,0.1,100000))", 10000, AngleMode::Radians, 1e-10);
+    {
+        ExpressionEngine engine;
+        engine.setSumMode(SumMode::Neumaier);
+        struct Case { const char* name; const wchar_t* expr; double expected; };
+        const Case cases[] = {
+            {"Neumaier cancellation", L"sum([1e16, 1, -1e16])", 1},
+            {"Neumaier sum of 0.1", L"sum(0.1, n, 1, 1e6)", 100000},
+            {"Neumaier mean", L"mean([1e16, 3, -1e16, 1])", 1},
+            {"Neumaier alternating series", L"sum((-1)^n/n, n, 1, 1e6)", -std::log(2.0) + 0.5e-6},
+        };
+        for (const auto& c : cases) {
+            double got = engine.evaluate(c.expr, AngleMode::Radians, 0, 0);
+            bool pass = std::fabs(got - c.expected) < 1e-12;
+            std::cout << (pass ? "[PASS] " : "[FAIL] ") << c.name << " = " << got << "\n";
+            (pass ? testsPassed : testsFailed)++;
+        }
+    }
+
+    std::cout << "\n--- Limits ---\n";
+    testElement("sin(x)/x at 0+", L"lim(sin(x)/x, x, 0, 1)", 0, 1, AngleMode::Radians, 1e-13);
+    testElement("Error estimate is small", L"lim(sin(x)/x, x, 0, 1)", 1, 0, AngleMode::Radians, 1e-12);
+    testElement("(1-cos x)/x^2 two-sided", L"lim((1-cos(x))/x^2, x, 0, 0)", 0, 0.5, AngleMode::Radians, 1e-12);
+    testElement("(1+x)^(1/x) -> e", L"lim((1+x)^(1/x), x, 0, 1)", 0, kE, AngleMode::Radians, 1e-12);
+    testElement("Removable singularity", L"lim((x^2-4)/(x-2), x, 2, 0)", 0, 4, AngleMode::Radians, 1e-12);
+    testElement("x ln x at 0+", L"lim(x*ln(x), x, 0, 1)", 0, 0, AngleMode::Radians, 1e-12);
+    testElement("1/x at 0+ diverges", L"lim(1/x, x, 0, 1)", 0, HUGE_VAL);
+    testElement("1/x at 0- diverges", L"lim(1/x, x, 0, -1)", 0, -HUGE_VAL);
+    testElement("Degree-mode trig", L"lim(sin(x)/x, x, 0, 1)", 0, kPi / 180, AngleMode::Degrees, 1e-13);
+    testThrows("Jump discontinuity", L"lim(abs(x)/x, x, 0, 0)");
+    testElement("Reduction in the body", L"lim(sum([x, 1]), x, 2, 0)", 0, 3, AngleMode::Radians, 1e-12);
+
+    std::cout << "\n--- Power Series ---\n";
+    testArray("sin(x) at 0", L"taylor(sin(x), x, 0, 5)", {0, 1, 0, -1.0 / 6, 0, 1.0 / 120}, AngleMode::Radians, 1e-15);
+    testArray("e^x at 1", L"taylor(e^x, x, 1, 3)", {kE, kE, kE / 2, kE / 6}, AngleMode::Radians, 1e-14);
+    testArray("1/(1-x) at 0", L"taylor(1/(1-x), x, 0, 4)", {1, 1, 1, 1, 1}, AngleMode::Radians, 1e-15);
+    testArray("sqrt(1+x) at 0", L"taylor(sqrt(1+x), x, 0, 3)", {1, 0.5, -0.125, 0.0625}, AngleMode::Radians, 1e-15);
+    testArray("atan(x) at 0", L"taylor(atan(x), x, 0, 5)", {0, 1, 0, -1.0 / 3, 0, 0.2}, AngleMode::Radians, 1e-15);
+    testArray("ln(x) at 1", L"taylor(ln(x), x, 1, 4)", {0, 1, -0.5, 1.0 / 3, -0.25}, AngleMode::Radians, 1e-15);
+    testArray("x^x at 1", L"taylor(x^x, x, 1, 3)", {1, 1, 1, 0.5}, AngleMode::Radians, 1e-14);
+    testArray("Polynomial is exact", L"taylor(x^3 - 2x, x, 0, 4)", {0, -2, 0, 1, 0}, AngleMode::Radians, 1e-15);
+    testArray("Built-in via formula", L"taylor(pvr(x, 4), x, 2, 2)", {1, 1, 0.25}, AngleMode::Radians, 1e-15);
+    testArray("Degree mode", L"taylor(sin(x), x, 90, 2)", {1, 0, -0.5 * (kPi / 180) * (kPi / 180)}, AngleMode::Degrees, 1e-15);
+    test("polyval of a series", L"polyval(taylor(exp(x), x, 0, 20), 1)", kE, AngleMode::Radians, 1e-14);
+    testArray("polyval over an array", L"polyval([1, 2, 3], [0, 1, 2])", {1, 6, 17});
+    test("exp(x)", L"exp(1)", kE);
+    testThrows("Series of factorial", L"taylor(x!, x, 1, 2)");
+    testThrows("Series not analytic", L"taylor(sqrt(x), x, 0, 2)");
+    testThrows("abs not analytic at 0", L"taylor(abs(x), x, 0, 2)");
+    testArray("abs of an even power", L"taylor(abs(x^2), x, 0, 2)", {0, 0, 1}, AngleMode::Radians, 1e-15);
+    testArray("geom at r = 1", L"taylor(geom(1, x, 2.5), x, 1, 2)", {3.5, 4.375, 2.1875}, AngleMode::Radians, 1e-15);
+    testArray("intpow at k = -1", L"taylor(intpow(1, 2, k), k, -1, 2)",
+              {std::log(2.0), std::log(2.0) * std::log(2.0) / 2, std::pow(std::log(2.0), 3) / 6}, AngleMode::Radians,
+              1e-15);
+    testThrows("Series of a rejected argument", L"taylor(sum(x), x, 2.5, 2)");
+
+    std::cout << "\n--- Polynomials ---\n";
+    testArray("coeffs of a power", L"coeffs((x+1)^3, x)", {1, 3, 3, 1});
+    testArray("coeffs merges terms", L"coeffs(3x^2 - 2x + 1 + x^2, x)", {1, -2, 4});
+    testArray("coeffs of a product", L"coeffs(x*(x-1)*(x-2)/2, x)", {0, 1, -1.5, 0.5});
+    testArray("coeffs with constant functions", L"coeffs(sin(pi/2) x^2 + 2^3, x)", {8, 0, 1});
+    testArray("polyder", L"polyder([1, 2, 3])", {2, 6});
+    testArray("polyint", L"polyint([1, 2, 3])", {0, 1, 1, 1});
+    test("polyval of coeffs", L"polyval(coeffs((2x+1)^5, x), 1)", 243);
+    test("Sparse polyval", L"polyval(coeffs(x^1000 + 1, x), 1.001)", std::pow(1.001, 1000) + 1, AngleMode::Radians, 1e-12);
+    testThrows("coeffs of sin(x)", L"coeffs(sin(x), x)");
+    testThrows("coeffs of a negative power", L"coeffs(x^-1, x)");
+    {
+        // The C type behind them, as calculator_dev.c uses it
+        Polynomial p;
+        poly_init(&p);
+        wchar_t text[64];
+        bool pass = poly_parse(L"-x^3 + 2.5x - 4 + 3x^3", &p);
+        poly_derivative(&p);
+        poly_to_string(&p, text, 64);
+        pass = pass && std::wstring(text) == L"6x^2+2.5" && !poly_parse(L"3x^", &p) && !poly_parse(L"x + + 1", &p);
+        poly_free(&p);
+        std::cout << (pass ? "[PASS] " : "[FAIL] ") << "poly_parse handles signs, merges terms, and rejects junk\n";
+        (pass ? testsPassed : testsFailed)++;
+    }
+    {
+        // A text longer than the buffer: the length needed comes back, and only whole terms are written
+        Polynomial p;
+        poly_init(&p);
+        std::wstring input = L"1";
+        for (int e = 1; e <= 40; ++e) input = L"3x^" + std::to_wstring(e) + L" + " + input;
+        bool pass = poly_parse(input.c_str(), &p);
+        std::vector<wchar_t> all(512);
+        size_t need = poly_to_string(&p, all.data(), all.size());
+        wchar_t text[64];
+        size_t got = poly_to_string(&p, text, 64);
+        std::wstring full(all.data()), part(text);
+        pass = pass && need == full.size() && got == need && need >= 64 && part.size() < 64 &&
+               full.compare(0, part.size(), part) == 0 && full[part.size()] == L'+';
+        poly_free(&p);
+        std::cout << (pass ? "[PASS] " : "[FAIL] ") << "poly_to_string reports the length of a truncated text\n";
+        (pass ? testsPassed : testsFailed)++;
+    }
+    testArray("polymul", L"polymul([1, 1], [1, -1])", {1, 0, -1});
+    testArray("polydiv", L"polydiv([-1, 0, 0, 1], [-1, 1])", {1, 1, 1});
+    testArray("polyrem", L"polyrem([-1, 0, 0, 1], [-2, 1])", {7});
+    testArray("polycomp", L"polycomp([1, 2, 3], [0, 1, 1])", {1, 2, 5, 6, 3});
+    testArray("polydiv by a higher degree", L"polydiv([1, 2], [0, 0, 1])", {0});
+    testThrows("polydiv by zero", L"polydiv([1, 2], [0])");
+    {
+        // Large products against direct sums: integer coefficients take the
+        // exact transform, fractional ones the complex FFT
+        std::vector<double> a(3000), b(2000), fa(3000), fb(2000);
+        for (size_t i = 0; i < a.size(); ++i) a[i] = static_cast<double>((i * 7919) % 2001) - 1000;
+        for (size_t i = 0; i < b.size(); ++i) b[i] = static_cast<double>((i * 104729) % 2001) - 1000;
+        for (size_t i = 0; i < fa.size(); ++i) fa[i] = std::sin(0.37 * i);
+        for (size_t i = 0; i < fb.size(); ++i) fb[i] = std::cos(0.91 * i);
+        std::vector<double> exact = polyMul(a, b), rounded = polyMul(fa, fb);
+        bool pass = exact.size() == a.size() + b.size() - 1 && rounded.size() == exact.size();
+        for (size_t k : {size_t(0), size_t(1999), size_t(2500), size_t(4998)}) {
+            double e = 0, f = 0;
+            for (size_t i = 0; i <= k && i < a.size(); ++i)
+                if (k - i < b.size()) {
+                    e += a[i] * b[k - i];
+                    f += fa[i] * fb[k - i];
+                }
+            pass = pass && exact[k] == e && std::fabs(rounded[k] - f) < 1e-10;
+        }
+        std::cout << (pass ? "[PASS] " : "[FAIL] ") << "polyMul exact on integers and close on reals past the FFT threshold\n";
+        (pass ? testsPassed : testsFailed)++;
+
+        // Operands of very different scale: the largest error against the
+        // direct sums, relative to the largest coefficient
+        std::vector<double> big(fb);
+        for (double& x : big) x *= 1e8;
+        std::vector<double> scaled = polyMul(fa, big);
+        double maxErr = 0, maxCoef = 0;
+        for (size_t k = 0; k < scaled.size(); ++k) {
+            double f = 0;
+            for (size_t i = 0; i <= k && i < fa.size(); ++i)
+                if (k - i < big.size()) f += fa[i] * big[k - i];
+            maxErr = std::max(maxErr, std::fabs(scaled[k] - f));
+            maxCoef = std::max(maxCoef, std::fabs(f));
+        }
+        pass = scaled.size() == exact.size() && maxErr <= 1e-11 * maxCoef;
+        std::cout << (pass ? "[PASS] " : "[FAIL] ") << "polyMul keeps its relative accuracy when one operand is 1e8 times larger\n";
+        (pass ? testsPassed : testsFailed)++;
+
+        // Dividing back out, through the Newton inverse
+        std::vector<double> q, r, num = rounded;
+        for (size_t i = 0; i < 5; ++i) num[i] += 0.5;
+        polyDivMod(num, fb, q, r);
+        double worst = 0;
+        for (size_t i = 0; i < fa.size(); ++i) worst = std::max(worst, std::fabs(q[i] - fa[i]));
+        for (size_t i = 0; i < r.size(); ++i) worst = std::max(worst, std::fabs(r[i] - (i < 5 ? 0.5 : 0.0)));
+        pass = q.size() == fa.size() && r.size() < fb.size() && worst < 1e-8;
+        std::cout << (pass ? "[PASS] " : "[FAIL] ") << "polyDivMod recovers quotient and remainder (max error " << worst << ")\n";
+        (pass ? testsPassed : testsFailed)++;
+    }
+    testArray("roots of a cubic", L"roots([-6, 11, -6, 1])", {1, 0, 2, 0, 3, 0}, AngleMode::Radians, 1e-12);
+    testArray("Complex roots", L"roots([1, 0, 1])", {0, -1, 0, 1}, AngleMode::Radians, 1e-15);
+    testArray("Roots at zero", L"roots(coeffs(x^3 - 2x^2, x))", {0, 0, 0, 0, 2, 0}, AngleMode::Radians, 1e-15);
+    testArray("Roots of a constant", L"roots([5])", {});
+    testThrows("roots of zero", L"roots([0, 0])");
+    {
+        // Degree 1000 with random coefficients: every root within rounding
+        // error, as the test in poly_roots itself judges it
+        std::vector<double> c(1001);
+        uint64_t state = 12345;
+        for (double& x : c) {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            x = static_cast<double>(state >> 11) / 9007199254740992.0 - 0.5;
+        }
+        Poly p = polyFromCoeffs(c);
+        Polynomial view = p.view();
+        std::vector<double> re(1000), im(1000), nr(1000), ni(1000), residual(1000);
+        bool pass = poly_roots(&view, re.data(), im.data()) == 1000;
+        poly_newton_many(c.data(), 1000, re.data(), im.data(), 1000, nr.data(), ni.data(), residual.data());
+        double worst = 0;
+        for (double r : residual) worst = std::max(worst, r);
+        pass = pass && worst <= 1.0;
+        std::cout << (pass ? "[PASS] " : "[FAIL] ") << "1000 roots of a random polynomial, worst residual " << worst << " of rounding\n";
+        (pass ? testsPassed : testsFailed)++;
+    }
+
+    std::cout << "\n--- Symbolic Derivatives ---\n";
+    test("d/dx x^3 at 2", L"diff(x^3, x, 2)", 12, AngleMode::Radians, 1e-15);
+    test("Product rule", L"diff(x*sin(x), x, 1)", std::sin(1.0) + std::cos(1.0), AngleMode::Radians, 1e-15);
+    test("Chain rule", L"diff(sqrt(x^2+1), x, 2)", 2 / std::sqrt(5.0), AngleMode::Radians, 1e-15);
+    test("General power x^x", L"diff(x^x, x, 2)", 4 * (std::log(2.0) + 1), AngleMode::Radians, 1e-14);
+    test("EE built-in vdiv", L"diff(vdiv(10, 1000, x), x, 1000)", 10.0 * 1000 / (2000.0 * 2000), AngleMode::Radians, 1e-15);
+    test("geom through r = 1", L"diff(geom(1, x, 3), x, 1)", 6, AngleMode::Radians, 1e-15);
+    test("intpow with k = -1", L"diff(intpow(1, x, -1), x, 2)", 0.5, AngleMode::Radians, 1e-15);
+    test("derivpow with h = 0", L"diff(derivpow(x, 2, 0), x, 3)", 2, AngleMode::Radians, 1e-6);
+    test("Degree-mode sin", L"diff(sin(x), x, 60)", 0.5 * kPi / 180, AngleMode::Degrees, 1e-15);
+    test("Degree-mode atan", L"diff(atan(x), x, 1)", 90 / kPi, AngleMode::Degrees, 1e-13);
+    testArray("Derivative over an array", L"diff(sin(x), x, [0, pi])", {1, -1}, AngleMode::Radians, 1e-15);
+    test("Derivative inside a range", L"sum(diff(x^2, x, n), n, 1, 10)", 110);
+    testThrows("diff needs a name", L"diff(x^2, 2)");
+    {
+        // One engine reuses its derivatives, but only for the same tree and angle mode
+        ExpressionEngine engine;
+        double range = engine.evaluate(L"sum(diff(x^3, x, n), n, 1, 2000)", AngleMode::Radians, 0, 0);
+        double rad = engine.evaluate(L"diff(sin(x), x, 0)", AngleMode::Radians, 0, 0);
+        double deg = engine.evaluate(L"diff(sin(x), x, 0)", AngleMode::Degrees, 0, 0);
+        double close = engine.evaluate(L"diff(x*1.0000000000000002, x, 1)", AngleMode::Radians, 0, 0);
+        double one = engine.evaluate(L"diff(x*1, x, 1)", AngleMode::Radians, 0, 0);
+        bool pass = range == 3.0 * 2000 * 2001 * 4001 / 6 && rad == 1.0 && std::fabs(deg - kPi / 180) < 1e-18 &&
+                    close == 1.0000000000000002 && one == 1.0;
+        std::cout << (pass ? "[PASS] " : "[FAIL] ") << "Derivatives are reused per tree and mode\n";
+        (pass ? testsPassed : testsFailed)++;
+    }
+    {
+        ExpressionEngine engine;
+        struct Case { const char* name; const wchar_t* expr; const wchar_t* expected; };
+        const Case cases[] = {
+            {"Power rule text", L"diff(x^2, x)", L"2*x"},
+            {"Like terms text", L"diff(3x^3 - 2x + 7, x)", L"9*x^2 - 2"},
+            {"Constant folding text", L"diff(x*ln(x), x)", L"ln(x) + 1"},
+            {"Zero elimination text", L"diff(x/x, x)", L"0"},
+            {"Inverse trig text", L"diff(asin(x), x)", L"1/sqrt(1 - x^2)"},
+            {"Formula expansion text", L"diff(pvr(x, 4), x)", L"0.5*x"},
+        };
+        for (const auto& c : cases) {
+            std::wstring got;
+            bool pass = engine.symbolicDerivative(c.expr, AngleMode::Radians, got) && got == c.expected;
+            std::cout << (pass ? "[PASS] " : "[FAIL] ") << c.name << "\n";
+            (pass ? testsPassed : testsFailed)++;
+        }
+        // The printed derivative compiles back to the same function (bound to x = 2 by a one-term sum)
+        std::wstring text;
+        engine.symbolicDerivative(L"diff(preal(2, 3, x)/x + x^x, x)", AngleMode::Degrees, text);
+        double printed = engine.evaluate(L"sum(" + text + L", x, 2, 2)", AngleMode::Degrees, 0, 0);
+        double direct = engine.evaluate(L"diff(preal(2, 3, x)/x + x^x, x, 2)", AngleMode::Degrees, 0, 0);
+        bool pass = std::fabs(printed - direct) < 1e-12 * std::fabs(direct);
+        std::cout << (pass ? "[PASS] " : "[FAIL] ") << "Printed derivative round-trips = " << printed << "\n";
+        (pass ? testsPassed : testsFailed)++;
+    }
+
+    std::cout << "\n--- Equation Solving ---\n";
+    test("Newton from a guess", L"solve(x^2 = 2, x, 1)", std::sqrt(2.0), AngleMode::Radians, 1e-15);
+    test("Back-solve vdiv for R2", L"solve(vdiv(12, 1000, x) = 5, x, 100)", 5000.0 / 7, AngleMode::Radians, 1e-10);
+    test("Back-solve xc for f", L"solve(xc(x, 1e-6) = 50, x, 1000)", 1e4 / kPi, AngleMode::Radians, 1e-9);
+    test("Brent in a bracket", L"solve(cos(x) = x, x, [0, 1])", 0.7390851332151607, AngleMode::Radians, 1e-15);
+    test("No symbolic form falls back", L"solve(limpow(x, 2, 1) = 4, x, 1)", 2, AngleMode::Radians, 1e-9);
+    testArray("All roots of sin", L"solve(sin(x), x, 0, 10)", {0, kPi, 2 * kPi, 3 * kPi}, AngleMode::Radians, 1e-14);
+    testArray("All roots of a cubic", L"solve(x^3 - 6x^2 + 11x - 6 = 0, x, -10, 10)", {1, 2, 3}, AngleMode::Radians, 1e-12);
+    testArray("Double root", L"solve((x-1)^2, x, 0, 3)", {1}, AngleMode::Radians, 1e-12);
+    testArray("Pole is not a root", L"solve(tan(x), x, 1, 5)", {kPi}, AngleMode::Radians, 1e-14);
+    testArray("Reduction in the equation", L"solve(sum([x, 1]) = 2, x, -3, 3)", {1}, AngleMode::Radians, 1e-14);
+    testArray("Degree mode", L"solve(sin(x) = 0.5, x, 0, 360)", {30, 150}, AngleMode::Degrees, 1e-11);
+    test("No roots gives empty array", L"sum(solve(x^2 = -1, x, 0, 1))", 0);
+    testThrows("Bracket without sign change", L"solve(x^2 = 2, x, [2, 3])");
+    testThrows("'=' outside solve", L"2 = 2");
+
+    std::cout << "\n--- Optimization ---\n";
+    test("Minimize a parabola", L"minimize((x-3)^2 + 1, x, 0)", 3, AngleMode::Radians, 1e-8);
+    testArray("Minimize Rosenbrock", L"minimize((1-x)^2 + 100(y-x^2)^2, x, y, -1.2, 1)", {1, 1}, AngleMode::Radians, 1e-6);
+    testArray("Minimize over data", L"minimize(sum((a*[1,2,3,4] + b - [3.1,4.9,7.2,8.8])^2), a, b, 0, 0)", {1.94, 1.15},
+              AngleMode::Radians, 1e-7);
+    test("Minimize in degree mode", L"minimize(cos(x), x, 170)", 180, AngleMode::Degrees, 1e-6);
+    testArray("Fit a line", L"fit(a*[1,2,3,4] + b = [3.1,4.9,7.2,8.8], a, b, 0, 0)", {1.94, 1.15}, AngleMode::Radians, 1e-12);
+    testArray("Fit an exponential", L"fit(a*e^(k*linspace(0,1,50)) = 2*e^(-1.5*linspace(0,1,50)), a, k, 1, 0)", {2, -1.5},
+              AngleMode::Radians, 1e-12);
+    testArray("Fit a sine to 10000 samples",
+              L"fit(a*sin(w*linspace(0,10,10000) + p) = 3*sin(1.3*linspace(0,10,10000) + 0.4), a, w, p, 2.5, 1.25, 0.3)",
+              {3, 1.3, 0.4}, AngleMode::Radians, 1e-12);
+    test("Fit preal current", L"fit(preal(230, i, [10,20,30,40]) = 230*6*cos([10,20,30,40]), i, 5)", 6,
+         AngleMode::Degrees, 1e-12);
+    testThrows("Names without starts", L"minimize(x^2, x, y, 1)");
+    testThrows("Reduced residuals", L"fit(sum(a*[1,2]) = 3, a, 1)");
+
+    std::cout << "\n--- Regression ---\n";
+    testArray("Linear fit", L"linfit([1,2,3,4], [3.1,4.9,7.2,8.8])", {1.15, 1.94}, AngleMode::Radians, 1e-12);
+    testArray("Quadratic fit", L"polyfit(linspace(-1,1,21), 1 - 2*linspace(-1,1,21) + 0.5*linspace(-1,1,21)^2, 2)",
+              {1, -2, 0.5}, AngleMode::Radians, 1e-12);
+    testArray("Exponential fit", L"expfit(linspace(0,2,30), 4*e^(-0.7*linspace(0,2,30)))", {4, -0.7},
+              AngleMode::Radians, 1e-12);
+    test("Fit feeds polyval", L"polyval(linfit([0,1,2], [1,3,5]), 10)", 21, AngleMode::Radians, 1e-12);
+    testThrows("Polyfit underdetermined", L"polyfit([1,2], [3,4], 2)");
+    testThrows("Expfit needs positive y", L"expfit([1,2,3], [1,0,2])");
+    testArray("Stats of an array", L"stats([1, 2, 3, 4, 10])", {5, 4, 12.5, 1.1384199576606, 1, 10}, AngleMode::Radians, 1e-12);
+    testArray("Stats with percentiles", L"stats([4, 1, 3, 2], [25, 50])", {4, 2.5, 5.0 / 3, 0, 1, 4, 1.75, 2.5},
+              AngleMode::Radians, 1e-12);
+    testThrows("Stats of no data", L"stats(primes(1))");
+    testThrows("Text outside a file argument", L"\"data.csv\" + 1");
+    {
+        // ~6 MB, so the file is streamed in more than one chunk
+        const char* path = "regression_test_data.csv";
+        {
+            std::ofstream out(path);
+            out << "# generated by test_all_functions\nx,quad,growth\n";
+            out << std::setprecision(17);
+            for (int i = 0; i < 200000; ++i) {
+                double x = i / 100000.0;
+                out << x << "," << (3 - x + 0.25 * x * x) << "," << 1.5 * std::exp(0.8 * x) << "\n";
+            }
+        }
+        struct Case { const char* name; std::wstring expr; std::vector<double> expected; };
+        std::vector<Case> cases = {
+            {"File linear fit", L"linfit(\"regression_test_data.csv\", 1, 1)", {0, 1}},
+            {"File quadratic fit", L"polyfit(\"regression_test_data.csv\", 1, 2, 2)", {3, -1, 0.25}},
+            {"File exponential fit", L"expfit(\"regression_test_data.csv\", 1, 3)", {1.5, 0.8}},
+        };
+        for (const Case& c : cases) {
+            ExpressionEngine engine;
+            try {
+                Value r = engine.evaluateValue(c.expr, AngleMode::Radians, 0, 0);
+                bool pass = r.arr.size() == c.expected.size();
+                for (size_t i = 0; pass && i < r.arr.size(); ++i) pass = std::fabs(r.arr[i] - c.expected[i]) < 1e-9;
+                std::cout << (pass ? "[PASS] " : "[FAIL] ") << c.name << "\n";
+                (pass ? testsPassed : testsFailed)++;
+            } catch (const std::exception& e) {
+                std::cout << "[FAIL] " << c.name << " threw exception: " << e.what() << "\n";
+                testsFailed++;
+            }
+        }
+        {
+            // Chunks are merged in a fixed order, so the thread count must not change a bit
+            ExpressionEngine one, four;
+            one.setThreadCount(1);
+            four.setThreadCount(4);
+            const std::wstring expr = L"polyfit(\"regression_test_data.csv\", 1, 2, 2)";
+            Value a = one.evaluateValue(expr, AngleMode::Radians, 0, 0);
+            Value b = four.evaluateValue(expr, AngleMode::Radians, 0, 0);
+            bool pass = a.arr == b.arr;
+            std::cout << (pass ? "[PASS] " : "[FAIL] ") << "File fit independent of thread count\n";
+            (pass ? testsPassed : testsFailed)++;
+        }
+        test("Data column", L"sum(data(\"regression_test_data.csv\", 1)^0)", 200000);
+        {
+            // Streamed moments match the array path; t-digest percentiles are
+            // close on uniform data, and neither depends on the thread count
+            ExpressionEngine one, four;
+            one.setThreadCount(1);
+            four.setThreadCount(4);
+            const std::wstring expr = L"stats(\"regression_test_data.csv\", 2, [1, 50, 99])";
+            Value a = one.evaluateValue(expr, AngleMode::Radians, 0, 0);
+            Value b = four.evaluateValue(expr, AngleMode::Radians, 0, 0);
+            Value c = one.evaluateValue(L"stats(data(\"regression_test_data.csv\", 2), [1, 50, 99])", AngleMode::Radians, 0, 0);
+            bool pass = a.arr == b.arr && a.arr.size() == 9 && c.arr.size() == 9;
+            for (size_t i = 0; pass && i < 9; ++i)
+                pass = std::fabs(a.arr[i] - c.arr[i]) <= (i < 6 ? 1e-9 : 1e-4) * std::max(1.0, std::fabs(c.arr[i]));
+            std::cout << (pass ? "[PASS] " : "[FAIL] ") << "Streamed stats match the in-memory ones\n";
+            (pass ? testsPassed : testsFailed)++;
+        }
+        std::remove(path);
+        testThrows("Missing data file", L"linfit(\"no_such_file.csv\", 1, 2)");
+    }
+
+    std::cout << "\n--- Double-Double Precision ---\n";
+    {
+        struct Case { const char* name; std::wstring expr; std::vector<double> expected; double tolerance; AngleMode mode; };
+        std::vector<Case> cases = {
+            {"Cancellation of a large sum", L"(1e16 + 1) - 1e16", {1}, 0, AngleMode::Radians},
+            {"Decimal literals", L"0.1 + 0.2 - 0.3", {0}, 1e-30, AngleMode::Radians},
+            {"geom with r near 1", L"geom(1, 1.000000000001, 99)", {100.00000000495}, 1e-12, AngleMode::Radians},
+            {"derivpow with tiny h", L"derivpow(2, 3, 1e-12)", {12}, 1e-12, AngleMode::Radians},
+            {"dbv of close voltages", L"dbv(1000000.000001, 1000000)", {8.6858896380606936e-12}, 1e-26, AngleMode::Radians},
+            {"Degree trig", L"sin(30) + cos(60) - 1", {0}, 1e-30, AngleMode::Degrees},
+            {"Factorial", L"20! / 19!", {20}, 0, AngleMode::Radians},
+            {"Arrays", L"[0.1, 0.2, 0.3] * 10", {1, 2, 3}, 0, AngleMode::Radians},
+            {"Special form inside", L"sum(n^2, n, 1, 10) + 0.5", {385.5}, 0, AngleMode::Radians},
+            {"Array built-in inside", L"max([1, 5, 2]) * 0.1", {0.5}, 0, AngleMode::Radians},
+        };
+        for (const Case& c : cases) {
+            ExpressionEngine engine;
+            try {
+                Value r = engine.evaluateValue(c.expr, c.mode, 0, 0, Precision::DoubleDouble);
+                bool pass = r.size() == c.expected.size();
+                for (size_t i = 0; pass && i < c.expected.size(); ++i) pass = std::fabs(r.at(i) - c.expected[i]) <= c.tolerance;
+                std::cout << (pass ? "[PASS] " : "[FAIL] ") << c.name << ": " << std::string(c.expr.begin(), c.expr.end())
+                          << " = " << r.at(0) << "\n";
+                (pass ? testsPassed : testsFailed)++;
+            } catch (const std::exception& e) {
+                std::cout << "[FAIL] " << c.name << " threw exception: " << e.what() << "\n";
+                testsFailed++;
+            }
+        }
+        for (const wchar_t* bad : {L"sqrt(-1)", L"1/(2-2)", L"1/1e-16", L"5%1e-16", L"asin(1.0000000000000000001)"}) {
+            ExpressionEngine engine;
+            bool threw = false;
+            try {
+                engine.evaluateValue(bad, AngleMode::Radians, 0, 0, Precision::DoubleDouble);
+            } catch (const std::exception&) {
+                threw = true;
+            }
+            std::wstring w = bad;
+            std::cout << (threw ? "[PASS] " : "[FAIL] ") << "Domain error in double-double: " << std::string(w.begin(), w.end()) << "\n";
+            (threw ? testsPassed : testsFailed)++;
+        }
+        // Built-ins keep their argument checks and special cases in double-double
+        for (const wchar_t* expr : {L"geom(1, 1, 5)", L"intpow(1, 2, -1)", L"geom(1, [1, 2], 3)", L"derivsin(0, 0)",
+                                    L"sum(2.5)", L"xc(-1, 1)", L"xl(-1, 1)", L"vdiv(1, 2, -2)"}) {
+            ExpressionEngine engine;
+            std::vector<double> results[2];
+            bool threw[2] = {false, false};
+            for (int dd = 0; dd < 2; ++dd) {
+                try {
+                    Value r = engine.evaluateValue(expr, AngleMode::Radians, 0, 0,
+                                                   dd ? Precision::DoubleDouble : Precision::Double);
+                    for (size_t i = 0; i < r.size(); ++i) results[dd].push_back(r.at(i));
+                } catch (const std::exception&) {
+                    threw[dd] = true;
+                }
+            }
+            bool pass = threw[0] == threw[1] && results[0].size() == results[1].size();
+            for (size_t i = 0; pass && i < results[0].size(); ++i)
+                pass = std::fabs(results[0][i] - results[1][i]) <= 1e-9 * std::fabs(results[0][i]);
+            std::wstring w = expr;
+            std::cout << (pass ? "[PASS] " : "[FAIL] ") << "Double-double agrees with double: " << std::string(w.begin(), w.end())
+                      << (threw[0] ? " (throws)" : "") << "\n";
+            (pass ? testsPassed : testsFailed)++;
+        }
+    }
+
+    std::cout << "\n--- Exact Integers ---\n";
+    {
+        struct Case { const char* name; std::wstring expr; std::string digits; };
+        std::vector<Case> cases = {
+            {"Factorial past 2^53", L"25!", "15511210043330985984000000"},
+            {"Power", L"2^100 - 1", "1267650600228229401496703205375"},
+            {"Quotient of factorials", L"171! / 170!", "171"},
+            {"Modulo keeps the dividend's sign", L"-7 % 3", "-1"},
+            {"Combinations", L"nCr(100, 50)", "100891344545564193334812497256"},
+            {"Permutations", L"nPr(20, 10)", "670442572800"},
+            {"Formula built-in", L"sum(10^12)", "500000000000500000000000"},
+        };
+        for (const Case& c : cases) {
+            ExpressionEngine engine;
+            std::wstring digits;
+            try {
+                bool exact = engine.evaluateExact(c.expr, AngleMode::Radians, 0, 0, digits);
+                bool pass = exact && std::string(digits.begin(), digits.end()) == c.digits;
+                std::cout << (pass ? "[PASS] " : "[FAIL] ") << c.name << ": " << std::string(c.expr.begin(), c.expr.end())
+                          << " = " << std::string(digits.begin(), digits.end()) << "\n";
+                (pass ? testsPassed : testsFailed)++;
+            } catch (const std::exception& e) {
+                std::cout << "[FAIL] " << c.name << " threw exception: " << e.what() << "\n";
+                testsFailed++;
+            }
+        }
+
+        ExpressionEngine engine;
+        std::wstring digits;
+        engine.evaluateExact(L"100000!", AngleMode::Radians, 0, 0, digits);
+        size_t zeros = digits.size() - digits.find_last_not_of(L'0') - 1;
+        bool pass = digits.size() == 456574 && digits.compare(0, 20, L"28242294079603478742") == 0 && zeros == 24999;
+        std::cout << (pass ? "[PASS] " : "[FAIL] ") << "100000! has 456574 digits, 24999 trailing zeros\n";
+        (pass ? testsPassed : testsFailed)++;
+
+        // Expressions that need floating point fall back to double at that point
+        struct Mixed { const char* name; std::wstring expr; double expected; };
+        std::vector<Mixed> mixed = {
+            {"Inexact division", L"7 / 2", 3.5},
+            {"Ratio beyond the double range", L"200! / 10^370", 78865.786736479050355},
+            {"Float operand", L"20! + 0.5", 2432902008176640000.5},
+            {"Negative exponent", L"2^-2", 0.25},
+        };
+        for (const Mixed& m : mixed) {
+            bool exact = engine.evaluateExact(m.expr, AngleMode::Radians, 0, 0, digits);
+            double v = engine.evaluate(m.expr, AngleMode::Radians, 0, 0, Precision::Exact);
+            bool ok = !exact && std::fabs(v - m.expected) <= 1e-12 * std::fabs(m.expected);
+            std::cout << (ok ? "[PASS] " : "[FAIL] ") << m.name << ": " << std::string(m.expr.begin(), m.expr.end()) << " = " << v << "\n";
+            (ok ? testsPassed : testsFailed)++;
+        }
+
+        for (const wchar_t* bad : {L"(-1)!", L"10^10^10", L"5 % 0", L"nCr(3, -1)"}) {
+            bool threw = false;
+            try {
+                engine.evaluateExact(bad, AngleMode::Radians, 0, 0, digits);
+            } catch (const std::exception&) {
+                threw = true;
+            }
+            std::wstring w = bad;
+            std::cout << (threw ? "[PASS] " : "[FAIL] ") << "Error in exact mode: " << std::string(w.begin(), w.end()) << "\n";
+            (threw ? testsPassed : testsFailed)++;
+        }
+    }
+
+    std::cout << "\n--- Plot Sampling ---\n";
+    {
+        ExpressionEngine engine;
+        std::vector<double> xs(501);
+        for (size_t i = 0; i < xs.size(); ++i) xs[i] = -10.0 + 20.0 * i / 500;
+        auto check = [](const char* name, bool pass) {
+            std::cout << (pass ? "[PASS] " : "[FAIL] ") << name << "\n";
+            (pass ? testsPassed : testsFailed)++;
+        };
+        auto pointwise = [&](const std::wstring& expr, AngleMode mode) {
+            std::vector<double> ys(xs.size());
+            for (size_t i = 0; i < xs.size(); ++i) {
+                std::wostringstream x;
+                x.precision(17);
+                x << L"(" << xs[i] << L")";
+                std::wstring e = expr;
+                for (size_t pos = 0; (pos = e.find(L'x', pos)) != std::wstring::npos; pos += x.str().size())
+                    e.replace(pos, 1, x.str());
+                try {
+                    ys[i] = engine.evaluate(e, mode, 0, 0);
+                } catch (const std::exception&) {
+                    ys[i] = std::nan("");
+                }
+            }
+            return ys;
+        };
+        auto same = [](const std::vector<double>& a, const std::vector<double>& b) {
+            for (size_t i = 0; i < a.size(); ++i)
+                if (a[i] != b[i] && !(std::isnan(a[i]) && std::isnan(b[i]))) return false;
+            return a.size() == b.size();
+        };
+
+        check("Full samples equal point evaluations",
+              same(engine.sample(L"sin(x)^2 + x^3 - 2x", L"x", xs, AngleMode::Radians, 0, 0),
+                   pointwise(L"sin(x)^2 + x^3 - 2x", AngleMode::Radians)));
+        check("Failing points are NaN, the rest still sampled",
+              same(engine.sample(L"ln(x) + 1/x", L"x", xs, AngleMode::Radians, 0, 0),
+                   pointwise(L"ln(x) + 1/x", AngleMode::Radians)));
+        // mean(x) of a single sample is the sample itself, not the mean of the sweep
+        std::vector<double> centred = engine.sample(L"x - mean(x)", L"x", xs, AngleMode::Radians, 0, 0);
+        check("Reductions are evaluated point by point",
+              std::all_of(centred.begin(), centred.end(), [](double y) { return y == 0.0; }));
+        std::vector<double> flat = engine.sample(L"2 + pi", L"x", xs, AngleMode::Radians, 0, 0);
+        check("Constant curves fill every sample", flat.size() == xs.size() && flat.back() == 2 + kPi);
+
+        struct FastCase { const char* name; std::wstring expr; AngleMode mode; };
+        const FastCase fastCases[] = {
+            {"Fast sin and exp within 1e-7", L"exp(-x^2/8) * sin(3x)", AngleMode::Radians},
+            {"Fast cos in degrees within 1e-7", L"cos(40x) + sin(x)", AngleMode::Degrees},
+            {"Fast ln and log within 1e-7", L"ln(x^2 + 1) - log(abs(x) + 0.5)", AngleMode::Radians},
+            {"Fast pow within 1e-7", L"pow(abs(x), 1.5) + 2^x + x^-3", AngleMode::Radians},
+        };
+        for (const FastCase& c : fastCases) {
+            std::vector<double> full = engine.sample(c.expr, L"x", xs, c.mode, 0, 0);
+            std::vector<double> fast = engine.sample(c.expr, L"x", xs, c.mode, 0, 0, Precision::Double, PlotPrecision::Fast);
+            bool pass = true;
+            for (size_t i = 0; i < xs.size(); ++i)
+                pass = pass && (fast[i] == full[i] || std::fabs(fast[i] - full[i]) <= 1e-7 * std::fabs(full[i]) ||
+                                (std::isnan(fast[i]) && std::isnan(full[i])));
+            check(c.name, pass);
+        }
+        std::vector<double> domain = engine.sample(L"ln(x)", L"x", xs, AngleMode::Radians, 0, 0, Precision::Double,
+                                                   PlotPrecision::Fast);
+        check("Fast ln keeps the domain error per point", std::isnan(domain[0]) && std::isnan(domain[250]) &&
+                                                               std::fabs(domain[500] - std::log(10.0)) < 1e-8);
+        // Fast mode folds the sum of monomials into one Horner pass; sin stays generic
+        const std::wstring polyCurve = L"0.5x^9 - 3x^7 + x^4/4 - 2x + 11 + sin(x)";
+        std::vector<double> full = engine.sample(polyCurve, L"x", xs, AngleMode::Radians, 0, 0);
+        std::vector<double> fast = engine.sample(polyCurve, L"x", xs, AngleMode::Radians, 0, 0, Precision::Double,
+                                                 PlotPrecision::Fast);
+        double height = 0.0, worst = 0.0;
+        for (size_t i = 0; i < xs.size(); ++i) {
+            height = std::max(height, std::fabs(full[i]));
+            worst = std::max(worst, std::fabs(fast[i] - full[i]));
+        }
+        check("Fast polynomial curves within 1e-12 of the curve height", worst <= 1e-12 * height);
+    }
+
     std::cout << "\n=== TEST SUMMARY ===\n";
     std::cout << "Passed: " << testsPassed << "\n";
     std::cout << "Failed: " << testsFailed << "\n";